@@ -0,0 +1,65 @@
+#ifndef ACCUMULATION_BUFFER_H
+#define ACCUMULATION_BUFFER_H
+
+#include <vector>
+#include <mutex>
+#include <iostream>
+
+#include "utils.h"
+
+// Sum of the radiance samples and the number of samples of every pixel, so
+// the image can be rendered in passes that each add a few samples per pixel.
+// The spread of the luminance of the passes (batch means) gives an estimate
+// of the error of every pixel.
+// Rows are updated under their own lock, a snapshot of the current estimate
+// can be taken by another thread while the passes are running and only
+// waits for the row it is copying.
+class AccumulationBuffer
+{
+public:
+	AccumulationBuffer(int width, int height);
+	~AccumulationBuffer();
+
+	// Zeroes pixels [x0, x1) of row y. The memory is not touched before, so
+	// the thread that renders the pixels should clear them (first touch).
+	void clear(int y, int x0, int x1);
+	// Adds sums of n_samples samples to pixels [x0, x1) of row y
+	void add(int y, int x0, int x1, const SpectralDistribution* sums, int n_samples);
+	// Adds the samples and pass statistics of a buffer of the same size
+	void add(const AccumulationBuffer& other);
+
+	// Sum over the number of samples, zero for pixels without samples.
+	// Not locked, only for when no pass is running.
+	SpectralDistribution getEstimate(int index) const;
+	unsigned int getNumberOfSamples(int index) const;
+	// Standard error of the luminance of the estimate relative to the
+	// luminance, dark pixels relative to a floor of 0.01. Infinite for
+	// pixels with less than two passes. Not locked.
+	float getRelativeError(int index) const;
+	// Root mean square of the relative error of the pixels
+	double getRelativeError() const;
+	// Estimate of every pixel, taken row by row under the row locks
+	void snapshot(std::vector<SpectralDistribution>* estimate) const;
+
+	// Sums, sample counts and pass statistics. Reading fails if the size
+	// differs.
+	void write(std::ostream& os) const;
+	bool read(std::istream& is);
+	// Bytes that write() writes
+	size_t getWrittenSize() const;
+
+	int getWidth() const;
+	int getHeight() const;
+private:
+	const int WIDTH_;
+	const int HEIGHT_;
+	SpectralDistribution* sums_;
+	unsigned int* n_samples_;
+	// Sum over the passes of the squared luminance of the pass sum divided
+	// by the samples of the pass, and the number of passes
+	float* square_sums_;
+	unsigned int* n_passes_;
+	mutable std::vector<std::mutex> row_mutexes_;
+};
+
+#endif // ACCUMULATION_BUFFER_H
@@ -0,0 +1,63 @@
+#ifndef ADAPTIVE_RENDERER_H
+#define ADAPTIVE_RENDERER_H
+
+#include <vector>
+
+#include "Camera.h"
+#include "Scene.h"
+
+// Distributes the camera samples of one render mode over the pixels in
+// rounds. Each pixel keeps the running mean and variance of its samples
+// (Welford) and only pixels whose estimated relative error is still above
+// the threshold get more samples in the next round, as many as the variance
+// estimate of their neighbourhood predicts they need but at most doubling
+// their samples.
+class AdaptiveRenderer
+{
+public:
+	AdaptiveRenderer(
+		Scene* scene,
+		Camera* camera,
+		int render_mode,
+		int sampler_type,
+		unsigned int seed,
+		int min_samples, // Given to every pixel in the first round
+		int max_samples,
+		float threshold); // Standard error of the mean relative to the mean
+	~AdaptiveRenderer(){};
+
+	// Returns false when all pixels have converged or reached max_samples
+	bool renderRound();
+	// Same unit as the value returned by Scene::tracePath()
+	SpectralDistribution getRadiance(int index) const;
+	int getNumberOfSamples(int index) const;
+	long getTotalNumberOfSamples() const;
+	int getNumberOfActivePixels() const;
+	int getNumberOfRounds() const;
+private:
+	struct PixelStatistics
+	{
+		int n_samples;
+		SpectralDistribution mean;
+		// Sum of squared differences from the mean of the luminance
+		double m2;
+		int n_needed;
+	};
+
+	// Sets the samples that bring the standard error of the mean of each
+	// pixel below the threshold
+	void updateSamplesNeeded();
+
+	Scene* scene_;
+	Camera* camera_;
+	const int RENDER_MODE_;
+	const int SAMPLER_TYPE_;
+	const unsigned int SEED_;
+	const int MIN_SAMPLES_;
+	const int MAX_SAMPLES_;
+	const float THRESHOLD_;
+	int n_rounds_;
+	std::vector<PixelStatistics> pixels_;
+};
+
+#endif // ADAPTIVE_RENDERER_H
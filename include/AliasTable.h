@@ -0,0 +1,30 @@
+#ifndef ALIAS_TABLE_H
+#define ALIAS_TABLE_H
+
+#include <vector>
+
+// Samples an index with probability proportional to its weight in constant
+// time, whatever the number of weights (Walker's alias method, built with
+// Vose's algorithm).
+class AliasTable
+{
+public:
+	AliasTable(){};
+	~AliasTable(){};
+
+	void build(const std::vector<float>& weights);
+	// u is uniform in [0, 1)
+	int sample(float u) const;
+	float probability(int i) const;
+	int size() const;
+private:
+	struct Bin
+	{
+		float threshold; // Probability of keeping the bin index
+		int alias; // Index picked otherwise
+		float probability; // Normalized weight of the bin index
+	};
+	std::vector<Bin> bins_;
+};
+
+#endif // ALIAS_TABLE_H
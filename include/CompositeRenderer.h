@@ -0,0 +1,135 @@
+#ifndef COMPOSITE_RENDERER_H
+#define COMPOSITE_RENDERER_H
+
+#include <vector>
+#include <chrono>
+
+#include "Camera.h"
+#include "Scene.h"
+#include "RenderSettings.h"
+#include "TileScheduler.h"
+#include "WavefrontRenderer.h"
+#include "AccumulationBuffer.h"
+
+// Renders Scene::COMPOSITE in progressive passes of a few samples per pixel
+// in to an accumulation buffer, tile by tile or, with settings.wavefront, in
+// wavefront batches. Sample i of a pixel is the same in both and does not
+// depend on how the samples are split in to passes.
+// The parts get their budgets by weighting the samples they are enabled in,
+// a pattern that only averages out over whole periods of samples. Passes
+// are whole periods, so the image after every pass is an unbiased estimate.
+class CompositeRenderer
+{
+public:
+	// The samples per pixel of each part are budgets within the samples of
+	// the shared camera path, which gets as many as the largest of them
+	CompositeRenderer(
+		Scene* scene,
+		Camera* camera,
+		const RenderSettings& settings,
+		int specular_samples,
+		int caustics_samples,
+		int diffuse_samples);
+	~CompositeRenderer();
+
+	// Renders the next getPassSamples() samples of every pixel. Returns
+	// false, without rendering, when all samples are done or the budget is
+	// reached. With a time limit or a noise target in the settings the
+	// samples of the parts only set their ratio.
+	bool renderPass();
+	// With a time limit, true when the next pass would end after the limit,
+	// counted from the start time. With a noise target, true when the
+	// estimated relative error is below it. Otherwise true when all samples
+	// are done. The samples are always whole weight periods, so the image
+	// is unbiased wherever the budget stops it.
+	bool isBudgetReached() const;
+	// Start of the time limit, the construction of the renderer by default
+	void setStartTime(std::chrono::steady_clock::time_point start_time);
+	// Renders samples [first_sample, end_sample) of every pixel. The ranges
+	// do not need to come in order, a worker of a distributed render gets
+	// the ones the coordinator gives it. They should start and end at whole
+	// weight periods.
+	void renderSamples(int first_sample, int end_sample);
+	// Adds n_samples samples per pixel rendered elsewhere in render_time
+	// seconds, used to predict the time of the next pass
+	void addSamples(const AccumulationBuffer& samples, int n_samples, double render_time);
+	// Removes all samples
+	void clear();
+	// Samples per pixel rendered so far, and of one period of the parts
+	// (all samples without a time limit or noise target)
+	int getNumberOfSamples() const;
+	int getTotalNumberOfSamples() const;
+	// False with a time limit or noise target
+	bool hasSampleLimit() const;
+	// settings.pass_samples rounded up to a multiple of the weight period
+	int getPassSamples() const;
+	int getWeightPeriod() const;
+	int getNumberOfPasses() const;
+	// Root mean square relative error of the pixels after the last pass
+	double getRelativeError() const;
+	// Everything the samples depend on: camera, sample budgets, sampler and
+	// path settings
+	const std::vector<float>& getParameters() const;
+	// Estimate of the pixels in the unit of the output image
+	const AccumulationBuffer& getAccumulationBuffer() const;
+
+	// Saves the accumulation buffer, the next sample of the pixels and, if
+	// n_photons > 0, the photon maps of the scene. Must be called between
+	// passes, so it ends at a whole weight period. The file is written
+	// under another name and renamed, so a render killed while saving keeps
+	// its previous checkpoint.
+	bool saveCheckpoint(const char* file_path, int n_photons);
+	// Continues from a checkpoint of the same scene, camera and settings.
+	// The samplers are counter based, the next sample index is all of their
+	// state. The photon maps are loaded in to the scene if n_photons > 0.
+	bool loadCheckpoint(const char* file_path, int n_photons);
+
+	// Tile statistics, summed over the passes
+	int getNumberOfThreads() const;
+	double getBusyTime(int thread) const;
+	int getNumberOfRenderedTiles(int thread) const;
+	int getNumberOfStolenTiles(int thread) const;
+	// Wavefront statistics, summed over the passes
+	double getStageTime(int stage) const;
+	int getNumberOfBatches() const;
+private:
+	// Weights of the parts of the path for sample i of each pixel
+	void prepareRay(Ray* r, int sample) const;
+	void renderTile(const TileScheduler::Tile& tile, int first_sample, int end_sample);
+
+	Scene* scene_;
+	Camera* camera_;
+	const int SAMPLER_TYPE_;
+	const int SPECULAR_SAMPLES_;
+	const int CAUSTICS_SAMPLES_;
+	const int DIFFUSE_SAMPLES_;
+	const int N_SAMPLES_;
+	// Samples after which the weights of the parts repeat
+	const int PERIOD_;
+	const int PASS_SAMPLES_;
+	const bool UNLIMITED_SAMPLES_;
+	const float TIME_LIMIT_;
+	const float TARGET_NOISE_;
+
+	TileScheduler scheduler_;
+	WavefrontRenderer* wavefront_; // NULL when rendering tiles
+	AccumulationBuffer accumulation_;
+	int n_samples_done_;
+	int n_passes_;
+	double relative_error_;
+	std::chrono::steady_clock::time_point start_time_;
+	// Of the passes rendered or added since the renderer was created
+	double render_time_;
+	int n_timed_passes_;
+	// Everything the samples depend on, checkpoints and workers must have
+	// the same
+	std::vector<float> parameters_;
+
+	std::vector<double> busy_times_;
+	std::vector<int> n_rendered_tiles_;
+	std::vector<int> n_stolen_tiles_;
+	double stage_times_[WavefrontRenderer::N_STAGES];
+	int n_batches_;
+};
+
+#endif // COMPOSITE_RENDERER_H
@@ -0,0 +1,23 @@
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include "utils.h"
+#include "AccumulationBuffer.h"
+
+// Writing of rendered images
+namespace image_io
+{
+	// Binary ppm of width * height rgb bytes
+	int savePPM(
+		const char* file_name,
+		const int width,
+		const int height,
+		unsigned char* data);
+	// Gamma corrected and clamped rgb bytes of a pixel
+	void toneMap(SpectralDistribution radiance, float gamma, unsigned char* rgb);
+	// Writes the current estimate of the accumulation buffer. Written next to
+	// the file and renamed, so the file is always a complete image.
+	bool saveEstimate(const char* file_name, const AccumulationBuffer& accumulation, float gamma);
+}
+
+#endif // IMAGE_IO_H
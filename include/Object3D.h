@@ -7,6 +7,7 @@
 
 #include <glm/glm.hpp>
 #include "utils.h"
+#include "Sampler.h"
 
 class Object3D
 {
@@ -92,7 +93,9 @@ public:
 	float 		getArea() const;
 	glm::vec3 		getNormal() const;
 
-	Ray shootLightRay();
+	// Cosine distributed direction from a point on the lamp. Uses two 2D
+	// samples, one for the position and one for the direction.
+	Ray shootLightRay(Sampler* sampler);
 
 	const SpectralDistribution radiosity; // [Watts/m^2]
 };
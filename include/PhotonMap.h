@@ -0,0 +1,90 @@
+#ifndef PHOTON_MAP_H
+#define PHOTON_MAP_H
+
+#include <vector>
+#include <mutex>
+#include <iostream>
+
+#include <glm/glm.hpp>
+
+#include "utils.h"
+
+// A photon packed in to 20 bytes (the format of Jensen's photon maps).
+// The position is kept in full precision, the direction is quantized to two
+// spherical angles and the flux is stored as shared exponent rgb (rgbe).
+struct CompactPhoton
+{
+	glm::vec3 position;
+	unsigned char theta, phi; // Quantized direction_in
+	unsigned char flux[4]; // Shared exponent rgb delta_flux [Watts]
+	short plane; // Splitting axis in the balanced kd tree
+
+	void encode(const Photon& p);
+	void setDeltaFlux(SpectralDistribution delta_flux);
+	glm::vec3 direction() const;
+	SpectralDistribution deltaFlux() const;
+};
+
+// A left balanced kd tree of compact photons stored in one flat array.
+// There are no child pointers, the children of the photon at the median of
+// a segment are the medians of its left and right sub segments.
+class PhotonMap
+{
+public:
+	PhotonMap();
+	~PhotonMap(){};
+
+	// Thread safe, can be called from the threads of a parallel loop. The
+	// photons are sorted on sort_key before balancing, so the map does not
+	// depend on the order in which threads stored them.
+	void store(const Photon& p, unsigned long long sort_key);
+	// Must be called after the last photon is stored and before lookups
+	void balance();
+	void clear();
+
+	void findWithinRange(
+		glm::vec3 position,
+		float radius,
+		std::vector<const CompactPhoton*>* photons) const;
+	// Closest photon whose direction is within about 25 degrees of normal.
+	// Returns NULL if there is no such photon closer than max_distance.
+	const CompactPhoton* findNearest(
+		glm::vec3 position,
+		glm::vec3 normal,
+		float max_distance) const;
+	// Sum of the flux of photons arriving from the front side of the surface
+	// divided by the area of the disc they were gathered from [Watts/m^2]
+	SpectralDistribution estimateIrradiance(
+		glm::vec3 position,
+		glm::vec3 normal,
+		float radius) const;
+
+	// Raw binary of the balanced tree, native byte order
+	void write(std::ostream& os) const;
+	bool read(std::istream& is);
+
+	CompactPhoton& operator[](const int i);
+	int size() const;
+	size_t memoryUsage() const;
+private:
+	void balanceSegment(int begin, int end);
+	void locatePhotons(
+		int begin,
+		int end,
+		glm::vec3 position,
+		float radius_squared,
+		std::vector<const CompactPhoton*>* photons) const;
+	void locateNearest(
+		int begin,
+		int end,
+		glm::vec3 position,
+		glm::vec3 normal,
+		float* distance_squared,
+		const CompactPhoton** nearest) const;
+
+	std::vector<CompactPhoton> photons_;
+	std::vector<unsigned long long> sort_keys_; // Only kept until balanced
+	std::mutex store_mutex_;
+};
+
+#endif // PHOTON_MAP_H
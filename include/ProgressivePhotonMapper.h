@@ -0,0 +1,46 @@
+#ifndef PROGRESSIVE_PHOTON_MAPPER_H
+#define PROGRESSIVE_PHOTON_MAPPER_H
+
+#include <vector>
+
+#include "Camera.h"
+#include "Scene.h"
+
+// Stochastic progressive photon mapping (Hachisuka and Jensen 2009).
+// Every pass traces new visible points, emits photons in to a fresh photon
+// map and updates the statistics of each pixel. The gather radius of each
+// pixel shrinks as more photons are found, so the estimate converges while
+// only the photons of one pass are kept in memory.
+class ProgressivePhotonMapper
+{
+public:
+	ProgressivePhotonMapper(
+		Scene* scene,
+		Camera* camera,
+		int photons_per_pass,
+		float initial_radius,
+		float alpha); // [0, 1] fraction of new photons to keep each pass
+	~ProgressivePhotonMapper(){};
+
+	void renderPass();
+	// Same unit as the value returned by Scene::traceRay()
+	SpectralDistribution getRadiance(int index) const;
+	int getNumberOfPasses() const;
+	long getNumberOfEmittedPhotons() const;
+private:
+	struct PixelStatistics
+	{
+		float radius;
+		float n_photons; // Accumulated photon count
+		SpectralDistribution flux; // Accumulated flux times brdf
+	};
+
+	Scene* scene_;
+	Camera* camera_;
+	const int PHOTONS_PER_PASS_;
+	const float ALPHA_;
+	int n_passes_;
+	std::vector<PixelStatistics> pixels_;
+};
+
+#endif // PROGRESSIVE_PHOTON_MAPPER_H
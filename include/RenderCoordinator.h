@@ -0,0 +1,107 @@
+#ifndef RENDER_COORDINATOR_H
+#define RENDER_COORDINATOR_H
+
+#include <vector>
+#include <map>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <sys/types.h>
+
+#include "CompositeRenderer.h"
+
+// Splits the samples of a composite render between worker processes, on
+// this machine or others. Workers connect over TCP, get ranges of samples
+// per pixel (jobs) as they finish the previous one and send back their
+// accumulation buffer, which is added to the buffer of the coordinator. The
+// ranges of workers that disconnect are given to other workers. Each worker
+// is served by its own thread.
+// Results are added in the order of their samples, results that come early
+// wait for the ones before them. The samples done are always a gapless
+// prefix of whole periods, and the sums are the same as when composite
+// renders the passes itself.
+// While rendering a job, workers send an empty message every
+// HEARTBEAT_INTERVAL_MS. A worker that sends nothing for WORKER_TIMEOUT_MS is
+// dropped like one that disconnected.
+class RenderCoordinator
+{
+public:
+	// Samples per pixel [first_sample, end_sample). Sent to a worker with
+	// end_sample <= first_sample when there are no more, and with
+	// first_sample < 0 when its settings differ from the coordinator.
+	struct Job
+	{
+		int first_sample;
+		int end_sample;
+	};
+	static const int HEARTBEAT_INTERVAL_MS = 10000;
+	static const int WORKER_TIMEOUT_MS = 60000;
+	// First message of a worker, it must match the coordinator. Besides the
+	// camera and settings it has the scene key and the photon map key of
+	// Scene, so workers with other scene files or photon maps are rejected.
+	static std::string makeHello(
+		const std::vector<float>& parameters,
+		unsigned long long scene_key,
+		unsigned long long photon_map_key);
+
+	// composite must not render itself while run() is running
+	RenderCoordinator(
+		CompositeRenderer* composite,
+		int job_samples,
+		unsigned long long scene_key,
+		unsigned long long photon_map_key);
+	~RenderCoordinator();
+
+	// Opens a port, 0 for any free one
+	bool listen(int port);
+	int getPort() const;
+	// Serves workers until all samples of composite are rendered or its
+	// budget is reached, which is checked after every result that is added.
+	// The jobs before the budget was reached are still finished.
+	// local_workers are the processes of workers started on this machine.
+	// Returns false if they all exited while jobs were open and no other
+	// worker was connected. They are waited for before returning.
+	bool run(const std::vector<pid_t>& local_workers);
+	int getNumberOfWorkers() const;
+private:
+	void serveWorker(int socket, int worker);
+	// Waits until a job is free. False when there are no more.
+	bool takeJob(Job* job);
+	// Adds the result of a job that took render_time seconds, or gives the
+	// job to another worker if samples is NULL. Takes samples over.
+	void finishJob(
+		const Job& job,
+		AccumulationBuffer* samples,
+		double render_time,
+		int worker);
+	bool isFinished() const;
+	// Removes the processes that have exited, waits for them if wait
+	static void reapProcesses(std::vector<pid_t>* processes, bool wait);
+
+	struct Result
+	{
+		AccumulationBuffer* samples;
+		int n_samples;
+		double render_time;
+	};
+
+	CompositeRenderer* composite_;
+	const int JOB_SAMPLES_;
+	const std::string HELLO_;
+	int listening_socket_;
+
+	std::mutex mutex_;
+	std::condition_variable job_finished_;
+	int next_sample_;
+	// By first sample, the lowest ones are given out first
+	std::map<int, Job> failed_jobs_;
+	// Results waiting for the ones before them, by first sample
+	std::map<int, Result> results_;
+	int n_jobs_running_;
+	int n_workers_connected_;
+	bool budget_reached_;
+	std::vector<std::thread> worker_threads_;
+};
+
+#endif // RENDER_COORDINATOR_H
@@ -0,0 +1,121 @@
+#ifndef RENDER_SERVER_H
+#define RENDER_SERVER_H
+
+#include <map>
+#include <deque>
+#include <list>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <glm/glm.hpp>
+
+#include "Scene.h"
+#include "RenderSettings.h"
+
+// Keeps a loaded scene with its octrees and photon maps and renders jobs
+// that clients send over a Unix domain socket, one at a time in the order
+// they came. A job has its own camera, resolution and samples per pixel of
+// the composite pass and is written to its own output file.
+//
+// Clients send one command per line. Every command is answered with one
+// line, except status without an id and wait:
+//   render key=value ...  Queues a job, answers "queued <id>". Keys are
+//                         output, width, height, eye, center, up (x,y,z),
+//                         fov (degrees), spp, spp-specular, spp-caustics,
+//                         spp-diffuse, time-limit and target-noise.
+//   status [id]           State and progress of the job. Without an id
+//                         "jobs <n>" and a line for each of the n jobs.
+//   wait id               A status line after every pass until the job ends,
+//                         the last one is the final state
+//   cancel id             Removes a queued job, stops a running one after
+//                         its current pass
+//   shutdown              Cancels all jobs and stops the server
+// Errors are answered with "error <reason>". Only the last MAX_ENDED_JOBS
+// jobs that ended are kept.
+class RenderServer
+{
+public:
+	// Jobs use the renderer settings and samples per pixel of settings
+	// unless they set their own
+	RenderServer(Scene* scene, const RenderSettings& settings);
+	~RenderServer();
+
+	bool listen(const char* socket_path);
+	// Serves clients until a shutdown command
+	void run();
+private:
+	enum JobState
+	{
+		QUEUED, RENDERING, DONE, FAILED, CANCELLED,
+	};
+	struct Job
+	{
+		int id;
+		std::string output_file;
+		int width;
+		int height;
+		glm::vec3 eye;
+		glm::vec3 center;
+		glm::vec3 up;
+		float fov; // Radians
+		int specular_samples;
+		int caustics_samples;
+		int diffuse_samples;
+		float time_limit;
+		float target_noise;
+
+		JobState state;
+		bool cancel_requested;
+		// Progress, n_updates counts the changes
+		int n_samples_done;
+		int n_samples_total;
+		double relative_error;
+		double render_time;
+		int n_updates;
+		// Clients waiting for the job, it is kept while there are any
+		int n_waiters;
+	};
+	struct Client
+	{
+		int socket;
+		bool finished;
+		std::thread thread;
+	};
+	static const int MAX_ENDED_JOBS = 100;
+
+	// Marks client finished when it disconnects
+	void serveClient(Client* client);
+	// Runs the queue until shutdown
+	void renderJobs();
+	void renderJob(Job* job);
+	// Parses the arguments of a render command, false with the reason in
+	// error if they are not valid
+	bool parseJob(const std::string& arguments, Job* job, std::string* error) const;
+	// One status line, called with mutex_ locked
+	std::string describeJob(const Job& job) const;
+	static bool isFinished(const Job& job);
+	// Drops the oldest ended jobs beyond MAX_ENDED_JOBS, called with mutex_
+	// locked
+	void pruneJobs();
+	// Joins the threads of clients that disconnected, called with mutex_
+	// locked
+	void reapClients();
+
+	Scene* scene_;
+	const RenderSettings settings_;
+	std::string socket_path_;
+	int listening_socket_;
+
+	std::mutex mutex_;
+	// Notified when a job is queued or makes progress, and on shutdown
+	std::condition_variable jobs_changed_;
+	std::map<int, Job> jobs_;
+	std::deque<int> queue_;
+	int next_job_id_;
+	bool shutting_down_;
+	std::list<Client> clients_;
+};
+
+#endif // RENDER_SERVER_H
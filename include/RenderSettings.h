@@ -0,0 +1,91 @@
+#ifndef RENDER_SETTINGS_H
+#define RENDER_SETTINGS_H
+
+// Settings for one rendering. The default values are used for anything not
+// given on the command line.
+struct RenderSettings
+{
+	RenderSettings();
+
+	const char* scene_file_path;
+
+	int width;
+	int height;
+	int sub_sampling_caustics;
+	int sub_sampling_monte_carlo;
+	int sub_sampling_direct_specular;
+	int number_of_photons_emission;
+	int sampler_type; // Sampler::Type used for the camera paths
+	// Surface interactions of camera paths before Russian roulette starts,
+	// and after which they are always terminated
+	int min_path_depth;
+	int max_path_depth;
+	// Samples taken at the first diffuse vertex of each camera path
+	int first_bounce_splits;
+	// Camera paths follow one of reflection and refraction at glass
+	bool stochastic_fresnel;
+	// Threads of the thread pool, 0 for all that openMP would use, and
+	// whether each is pinned to its own CPU
+	int n_threads;
+	bool pin_threads;
+	// Side of the square tiles the image is rendered in and their order
+	// (TileScheduler::Order)
+	int tile_size;
+	int tile_order;
+	// The composite pass is rendered in passes of pass_samples samples per
+	// pixel. A snapshot of the image so far is written every
+	// snapshot_interval seconds (0 for never) and on SIGUSR1.
+	int pass_samples;
+	float snapshot_interval;
+	// Passes are added until the time limit in seconds would be exceeded or
+	// the estimated relative error is below target_noise, 0 for none. The
+	// samples per pixel settings then only set the ratio of the parts.
+	float time_limit;
+	float target_noise;
+	// A checkpoint is saved to checkpoint_file between passes every
+	// checkpoint_interval seconds (0 for never) and when the process is
+	// asked to stop. resume continues from it.
+	const char* checkpoint_file;
+	float checkpoint_interval;
+	bool resume;
+	// The composite pass is traced in batches of wavefront_batch_size
+	// camera paths one stage at a time instead of in tiles
+	bool wavefront;
+	int wavefront_batch_size;
+	// Distributed rendering of the composite pass. The coordinator listens
+	// on coordinator_port (0 for any free port, -1 when not a coordinator)
+	// and starts local_workers worker processes of its own. A worker
+	// renders the jobs of the coordinator at worker_address, "host:port".
+	int coordinator_port;
+	int local_workers;
+	const char* worker_address;
+	// Keeps the scene loaded and renders the jobs of clients of the Unix
+	// socket at server_socket, NULL for a single render
+	const char* server_socket;
+	// Renders the frames of the camera keyframes in sequence_file to
+	// sequence_output followed by the frame number, NULL for a single render
+	const char* sequence_file;
+	const char* sequence_output;
+	// Photon maps are saved to and loaded from the working directory
+	bool photon_map_cache;
+
+	// Stochastic progressive photon mapping replaces the caustics and
+	// Monte Carlo passes
+	bool progressive_photon_mapping;
+	int progressive_passes;
+	int progressive_photons_per_pass;
+	float progressive_initial_radius;
+	float progressive_alpha;
+
+	// Monte Carlo samples are given to the pixels in rounds until the
+	// relative error of each pixel is below the threshold
+	bool adaptive_sampling;
+	float adaptive_threshold;
+	int adaptive_min_samples;
+	int adaptive_max_samples;
+};
+
+// Returns false and prints usage if the arguments are not valid
+bool parseRenderSettings(int argc, char const *argv[], RenderSettings* settings);
+
+#endif // RENDER_SETTINGS_H
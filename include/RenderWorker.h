@@ -0,0 +1,31 @@
+#ifndef RENDER_WORKER_H
+#define RENDER_WORKER_H
+
+#include <string>
+
+#include "CompositeRenderer.h"
+
+// Renders the jobs a RenderCoordinator gives it with its own composite
+// renderer, which must have the same scene, photon map, camera and settings
+class RenderWorker
+{
+public:
+	// The keys are the ones of Scene, see RenderCoordinator::makeHello()
+	RenderWorker(
+		CompositeRenderer* composite,
+		unsigned long long scene_key,
+		unsigned long long photon_map_key);
+	~RenderWorker(){};
+
+	// Connects to the coordinator at "host:port" and renders jobs until it
+	// has no more. Returns false if the connection failed or broke, or the
+	// coordinator has other settings.
+	bool run(const std::string& coordinator_address);
+	int getNumberOfJobs() const;
+private:
+	CompositeRenderer* composite_;
+	const std::string HELLO_;
+	int n_jobs_;
+};
+
+#endif // RENDER_WORKER_H
@@ -0,0 +1,103 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <glm/glm.hpp>
+
+// Source of sample values for one pixel (or photon path) at a time. The
+// values only depend on the seed, the pixel, the sample index and the
+// dimension, so there is no state shared between threads and the result
+// does not depend on the order in which samples are computed.
+class Sampler
+{
+public:
+	Sampler(unsigned int seed);
+	virtual ~Sampler(){};
+
+	enum Type{
+	  INDEPENDENT, STRATIFIED, HALTON, SOBOL,
+	};
+	static const int N_TYPES = 4;
+	static Sampler* create(int type, unsigned int seed);
+	static const char* getTypeName(int type);
+
+	// Restarts the dimensions for a new sample of the pixel. n_samples is
+	// the number of samples that will be taken for the pixel, only the
+	// stratified sampler needs it.
+	void startSample(
+		unsigned int pixel,
+		unsigned int sample,
+		unsigned int n_samples = 0);
+	// Uniform in [0, 1)
+	virtual float next1D() = 0;
+	virtual glm::vec2 next2D() = 0;
+
+	// Dimension of the next value. Setting it after startSample() continues
+	// a sample that was left, or gives branches of a path their own values.
+	unsigned int getDimension() const;
+	void setDimension(unsigned int dimension);
+
+	// Increases with every value drawn for the sample. Unique for every
+	// (sample, dimension) of the same pixel.
+	unsigned long long getStreamPosition() const;
+
+	// Seeds used to keep the different uses of random numbers independent
+	static const unsigned int PHOTON_SEED = 1;
+	static const unsigned int PROGRESSIVE_SEED = 2;
+	static const unsigned int MONTE_CARLO_SEED = 5;
+protected:
+	// Random number for the current pixel and sample
+	unsigned int hash(unsigned int dimension) const;
+	// Random number that is the same for all samples of the current pixel
+	unsigned int pixelHash(unsigned int dimension) const;
+
+	unsigned int seed_;
+	unsigned int pixel_;
+	unsigned int sample_;
+	unsigned int n_samples_;
+	unsigned int dimension_;
+};
+
+// Uncorrelated uniform random numbers from a pcg4d hash
+class IndependentSampler : public Sampler
+{
+public:
+	IndependentSampler(unsigned int seed = 0);
+	float next1D();
+	glm::vec2 next2D();
+};
+
+// Jittered strata over the n_samples of a pixel. Each 1D dimension is
+// stratified and each 2D dimension is a scrambled Hammersley point set,
+// with their own random permutation so the dimensions are not correlated.
+// Without n_samples it is the same as the independent sampler.
+class StratifiedSampler : public Sampler
+{
+public:
+	StratifiedSampler(unsigned int seed = 0);
+	float next1D();
+	glm::vec2 next2D();
+};
+
+// Radical inverse of the sample index in the prime base of each dimension,
+// Owen scrambled per pixel. Dimensions after the tabulated primes are
+// independent.
+class HaltonSampler : public Sampler
+{
+public:
+	HaltonSampler(unsigned int seed = 0);
+	float next1D();
+	glm::vec2 next2D();
+};
+
+// Owen scrambled Sobol (0, 2) sequence padded to all dimensions, using the
+// hash based scrambling and shuffling of Burley, "Practical Hash-based
+// Owen Scrambling" (2020). Does not need the number of samples in advance.
+class SobolSampler : public Sampler
+{
+public:
+	SobolSampler(unsigned int seed = 0);
+	float next1D();
+	glm::vec2 next2D();
+};
+
+#endif // SAMPLER_H
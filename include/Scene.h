@@ -3,42 +3,106 @@
 
 #include <vector>
 #include <map>
-#include <random>
+#include <string>
+#include <iostream>
 
 #include <glm/glm.hpp>
 
 #include "utils.h"
 #include "Object3D.h"
-#include "../external_libraries/common_include/kdtree++/kdtree.hpp"
+#include "PhotonMap.h"
+#include "AliasTable.h"
+#include "Sampler.h"
 
 class Scene
 {
 private:
-	std::random_device rd_;
-	std::mt19937* gen_;
-	std::uniform_real_distribution<float>* dis_;
-
 	std::vector<Object3D*> objects_;
 	std::vector<LightSource*> lamps_;
+	// Picks lamps with probability proportional to their emitted flux
+	AliasTable lamp_selection_;
 	std::map<std::string, Material*> materials_;
 
-	KDTree::KDTree<3, KDTreeNode> photon_map_;
+	const std::string file_path_;
+	std::vector<std::string> mesh_file_paths_;
+
+	// Photons that have only been reflected specularly or refracted
+	PhotonMap caustic_map_;
+	// All photons hitting diffuse surfaces. Only kept while precomputing,
+	// or for one pass when doing progressive photon mapping
+	PhotonMap global_map_;
+	// Every IRRADIANCE_SAMPLE_RATE:th global photon with its direction being
+	// the surface normal and its flux the precomputed irradiance
+	PhotonMap irradiance_map_;
+	static const int IRRADIANCE_SAMPLE_RATE = 4;
+
+	// Camera paths are never terminated by Russian roulette before
+	// min_path_depth_ surface interactions and always at max_path_depth_
+	int min_path_depth_;
+	int max_path_depth_;
+	// Shadow rays and indirect rays per camera path at its first diffuse
+	// vertex, deeper vertices trace one of each
+	int first_bounce_splits_;
+	int diffuse_render_mode_;
+	// Camera paths continue through only one of the reflected and refracted
+	// rays at glass surfaces instead of both
+	bool stochastic_fresnel_;
+
+	// Counts of the camera paths, one per thread and each on its own cache
+	// line so that threads do not share them
+	struct alignas(64) RayCounters
+	{
+		unsigned long long paths; // Camera rays
+		unsigned long long rays; // All rays, including shadow rays
+		unsigned long long vertices; // Surface interactions
+	};
+	static_assert(sizeof(RayCounters) == 64, "RayCounters must fill one cache line");
+	// Allocated with posix_memalign, new and std::allocator only give the
+	// alignment of malloc before C++17
+	const int N_RAY_COUNTERS_;
+	RayCounters* ray_counters_;
+	RayCounters& getRayCounters();
 
 	friend struct scene_traverser;
+	friend class WavefrontRenderer;
 	
   	// Normal path tracing for diffuse ray
 	SpectralDistribution traceDiffuseRay(
 		Ray r,
 		int render_mode,
+		Sampler* sampler,
 		IntersectionData id,
 		int iteration);
 	SpectralDistribution traceLocalDiffuseRay(
 		Ray r,
 		int render_mode,
+		Sampler* sampler,
 		IntersectionData id);
+	// Shadow ray from a diffuse vertex towards a point on a lamp
+	struct ShadowRay
+	{
+		Ray ray;
+		float lamp_probability; // Of picking the lamp
+		float distance_squared; // To the point on the lamp
+		float cos_theta; // Between the ray and the surface normal
+	};
+	// Picks a lamp by its flux and a point on it. Returns false if the point
+	// is behind the surface, then no ray needs to be cast.
+	bool sampleShadowRay(
+		const Ray& r,
+		const IntersectionData& id,
+		Sampler* sampler,
+		ShadowRay* shadow_ray);
+	// Light of the lamp the shadow ray hit reflected in direction_out
+	SpectralDistribution evaluateShadowRay(
+		glm::vec3 direction_out,
+		const IntersectionData& id,
+		const ShadowRay& shadow_ray,
+		const LightSourceIntersectionData& lamp_id) const;
 	SpectralDistribution traceIndirectDiffuseRay(
 		Ray r,
 		int render_mode,
+		Sampler* sampler,
 		IntersectionData id,
 		int iteration);
 	
@@ -46,34 +110,149 @@ private:
 	SpectralDistribution traceSpecularRay(
 		Ray r,
 		int render_mode,
+		Sampler* sampler,
 		IntersectionData id,
 		int iteration);
 	SpectralDistribution traceRefractedRay(
 		Ray r,
 		int render_mode,
+		Sampler* sampler,
 		IntersectionData id,
 		int iteration,
 		glm::vec3 offset,
 		bool inside);
 
+	// Photon i of the call is sample first_photon + i of n_photons_total.
+	// sample_index tells calls for the same photons apart.
+	void emitPhotons(
+		const int first_photon,
+		const int n_photons,
+		const int n_photons_total,
+		const int sample_index,
+		int render_mode);
+	void precomputeIrradiance();
+	// Radiance of the caustic photons around position reflected towards -r
+	SpectralDistribution gatherCausticRadiance(
+		Ray r,
+		IntersectionData id,
+		glm::vec3 position);
+	SpectralDistribution evaluateGlobalRadiance(
+		Ray r,
+		IntersectionData id,
+		glm::vec3 position);
+
+	// Receives what the surface vertices of a camera path produce
+	class PathVertexSink
+	{
+	public:
+		virtual ~PathVertexSink(){};
+		// Radiance towards the camera, already times the path throughput
+		virtual void addRadiance(const SpectralDistribution& radiance) = 0;
+		// Continuation of the path, its radiance is the throughput
+		virtual void addBranch(const Ray& r, int render_mode, int iteration) = 0;
+		// Shadow ray of a diffuse vertex. If it hits its lamp, the radiance
+		// is throughput times evaluateShadowRay().
+		virtual void addShadowRay(
+			const ShadowRay& shadow_ray,
+			glm::vec3 direction_out,
+			const IntersectionData& id,
+			const SpectralDistribution& throughput) = 0;
+	};
+	struct BranchStackSink;
+	// Russian roulette and scattering at a surface hit by a camera path.
+	// Shared by tracePath() and the wavefront renderer.
+	void shadeSurface(
+		Ray ray,
+		const IntersectionData& id,
+		int render_mode,
+		int iteration,
+		Sampler* sampler,
+		PathVertexSink* sink);
+
+	// Radiance of a lamp hit by r, in the unit of traceRay()
+	SpectralDistribution evaluateLampHit(
+		const Ray& r,
+		const LightSourceIntersectionData& lamp_id,
+		int render_mode) const;
+
 	bool intersect(IntersectionData* id, Ray r);
 	bool intersectLamp(LightSourceIntersectionData* light_id, Ray r);
 	glm::vec3 shake(glm::vec3 r, float power);
+	float getSurvivalProbability(const Ray& r, int render_mode, int iteration) const;
 public:
 	Scene(const char* file_path);
 	~Scene();
 	
 	enum RenderMode{
 	  PHOTON_MAPPING, CAUSTICS, WHITTED_SPECULAR, MONTE_CARLO,
+	  // Monte Carlo until the first diffuse bounce, then the precomputed
+	  // irradiance of the global photon map is used
+	  FINAL_GATHERING,
+	  // Photons are only stored in the global map
+	  PROGRESSIVE_PHOTON_MAPPING,
+	  // WHITTED_SPECULAR, CAUSTICS and the diffuse render mode along one
+	  // camera path, each part scaled by its weight in the ray
+	  COMPOSITE,
 	};
 	
-	SpectralDistribution traceRay(Ray r, int render_mode, int iteration = 0);
+	SpectralDistribution traceRay(
+		Ray r,
+		int render_mode,
+		Sampler* sampler,
+		int iteration = 0);
+	// Same as traceRay() for camera rays (all modes but the photon mapping
+	// ones) but iterative. The branches of the path are kept on a small
+	// fixed size stack and carry their own throughput, instead of recursing
+	// and weighting the returned radiance.
+	SpectralDistribution tracePath(
+		Ray r,
+		int render_mode,
+		Sampler* sampler);
+	// Depth of camera paths, photon paths are not affected
+	void setPathDepth(int min_depth, int max_depth);
+	void setFirstBounceSplitting(int n_splits);
+	// MONTE_CARLO (default) or FINAL_GATHERING, used by COMPOSITE from the
+	// first diffuse vertex on
+	void setDiffuseRenderMode(int render_mode);
+	// Refraction or reflection is picked with probability of the Fresnel
+	// term in tracePath(). Without it each glass surface doubles the rays.
+	void setStochasticFresnel(bool stochastic);
 	void buildPhotonMap(const int n_photons);
+	// The photon maps only depend on the scene and not on the camera, so
+	// they can be saved and reused. The key is a hash of the scene file, the
+	// mesh files and the number of photons. Loading fails if it differs.
+	unsigned long long getPhotonMapKey(const int n_photons);
+	// Hash of the scene file and the mesh files
+	unsigned long long getSceneKey();
+	bool savePhotonMap(const char* file_path, const int n_photons);
+	bool loadPhotonMap(const char* file_path, const int n_photons);
+	// The same as the files, for embedding the maps in other files
+	bool writePhotonMap(std::ostream& os, const int n_photons);
+	bool readPhotonMap(std::istream& is, const int n_photons);
+
+	// Progressive photon mapping. Each pass emits photons in to a fresh map
+	// and gathers them at new visible points.
+	void buildProgressivePhotonMap(const int n_photons, const int pass);
+	bool traceVisiblePoint(Ray r, Sampler* sampler, VisiblePoint* vp);
+	// Sum of photon flux times brdf. n_photons is the number of photons used.
+	SpectralDistribution gatherPhotons(
+		const VisiblePoint& vp,
+		float radius,
+		int* n_photons);
 
 	int getNumberOfTriangles();
 	int getNumberOfObjects();
 	int getNumberOfSpheres();
-	int getNumberOfPhotons();
+	int getNumberOfCausticPhotons();
+	int getNumberOfIrradiancePhotons();
+
+	// Statistics of the camera paths traced since the last reset
+	void resetRayStatistics();
+	unsigned long long getNumberOfPaths();
+	// Surface interactions per camera ray
+	double getAveragePathLength();
+	// Rays, including shadow rays, per camera ray
+	double getRaysPerSample();
 };
 
 #endif // SCENE_H
\ No newline at end of file
@@ -0,0 +1,76 @@
+#ifndef SEQUENCE_RENDERER_H
+#define SEQUENCE_RENDERER_H
+
+#include <vector>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+#include "Scene.h"
+#include "RenderSettings.h"
+#include "CompositeRenderer.h"
+
+// Renders the frames of a camera path through one loaded scene, so the
+// octrees and photon maps are only built once. The camera of every frame is
+// interpolated between keyframes. While a frame renders, the camera and
+// buffers of the next one are set up and the previous one is written, on
+// threads of their own.
+class SequenceRenderer
+{
+public:
+	struct Keyframe
+	{
+		int frame;
+		glm::vec3 eye;
+		glm::vec3 center;
+		glm::vec3 up;
+		float fov; // Radians
+	};
+	// One keyframe per line: "frame eye_x eye_y eye_z center_x center_y
+	// center_z [fov_degrees [up_x up_y up_z]]", lines starting with # are
+	// comments. Frame numbers must increase. The fov defaults to 60 degrees
+	// and up to the y axis.
+	static bool loadKeyframes(const char* file_path, std::vector<Keyframe>* keyframes);
+
+	// Every frame renders the composite pass with the samples per pixel of
+	// the parts. A time limit or noise target in settings applies to each
+	// frame on its own.
+	SequenceRenderer(
+		Scene* scene,
+		const RenderSettings& settings,
+		const std::vector<Keyframe>& keyframes,
+		int specular_samples,
+		int caustics_samples,
+		int diffuse_samples);
+	~SequenceRenderer(){};
+
+	// Renders the frames from the first to the last keyframe to
+	// output_prefix + frame number (four digits) + ".ppm". Returns false if
+	// a frame could not be written.
+	bool render(const std::string& output_prefix);
+	int getFirstFrame() const;
+	int getLastFrame() const;
+	// Camera of a frame, Catmull-Rom spline through the eye and center of
+	// the keyframes, fov and up linear between them
+	Keyframe getCamera(int frame) const;
+private:
+	struct Frame
+	{
+		int number;
+		Camera* camera;
+		CompositeRenderer* composite;
+	};
+	Frame* prepareFrame(int frame) const;
+	void renderFrame(Frame* frame) const;
+	static void deleteFrame(Frame* frame);
+
+	Scene* scene_;
+	const RenderSettings settings_;
+	const std::vector<Keyframe> keyframes_;
+	const int SPECULAR_SAMPLES_;
+	const int CAUSTICS_SAMPLES_;
+	const int DIFFUSE_SAMPLES_;
+};
+
+#endif // SEQUENCE_RENDERER_H
@@ -0,0 +1,43 @@
+#ifndef SOCKET_H
+#define SOCKET_H
+
+#include <string>
+#include <cstddef>
+
+// Blocking TCP and Unix domain sockets as plain file descriptors. Functions that create a
+// socket return -1 and print the reason on failure. Messages are prefixed
+// with their length, in the byte order of the machine, so both ends must
+// be the same kind of machine.
+namespace socket_io
+{
+	// Listens on port of all interfaces, 0 for any free port
+	int listenTcp(int port);
+	// Port a listening socket was bound to
+	int getPort(int socket);
+	int connectTcp(const std::string& host, int port);
+	// Unix domain socket at file_path, replacing a file left there
+	int listenUnix(const std::string& file_path);
+	int connectUnix(const std::string& file_path);
+	// Splits "host:port"
+	bool parseAddress(const std::string& address, std::string* host, int* port);
+
+	// Waits at most timeout_ms for a connection, -1 if there was none
+	int acceptConnection(int listening_socket, int timeout_ms);
+	void closeSocket(int socket);
+	// Ends both directions, a thread blocked receiving on it returns
+	void shutdownSocket(int socket);
+
+	// Receiving fails after timeout_ms without data
+	bool setReceiveTimeout(int socket, int timeout_ms);
+
+	bool sendAll(int socket, const void* data, size_t size);
+	bool receiveAll(int socket, void* data, size_t size);
+	bool sendMessage(int socket, const std::string& message);
+	// Fails without reading the message if it is longer than max_size
+	bool receiveMessage(int socket, std::string* message, size_t max_size);
+	// Text lines ending with '\n', which is not part of line
+	bool sendLine(int socket, const std::string& line);
+	bool receiveLine(int socket, std::string* line);
+}
+
+#endif // SOCKET_H
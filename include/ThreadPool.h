@@ -0,0 +1,70 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// The threads of the process. They are started once and wait between tasks,
+// so every phase of the program (octree, photons, rendering, tonemapping)
+// runs on the same threads. With pinning, thread i stays on the i:th CPU the
+// process may use. Memory that a thread touches first is then placed in the
+// memory of its NUMA node, so buffers should be initialized by the threads
+// that will use them. Placement is per memory page, a page shared by work
+// of several threads ends up on the node of only one of them.
+class ThreadPool
+{
+public:
+	// The pool of the process. Created with all threads openMP would use
+	// (OMP_NUM_THREADS), not pinned, unless initialize() was called first.
+	static ThreadPool& instance();
+	// Replaces the pool of the process, n_threads <= 0 for the default.
+	// Must not be called while a task is running.
+	static void initialize(int n_threads, bool pin_threads);
+	// Index of the calling thread in its pool. 0 for the thread that calls
+	// run() and for all threads outside the pool, so data kept per index
+	// (e.g. the ray counters of Scene) may only be used by one of them at a
+	// time. Threads outside the pool should trace through run(), which runs
+	// one task at a time, and not on their own while a task is running.
+	static int getThreadIndex();
+
+	~ThreadPool();
+
+	int getNumberOfThreads() const;
+	bool isPinned() const;
+
+	// Calls task(thread) once on every thread of the pool, the calling thread
+	// being thread 0, and returns when all calls have returned. Called from
+	// within a task, all calls are made on the calling thread.
+	void run(const std::function<void(int)>& task);
+	// Calls body(i, thread) for every i in [begin, end). Chunks of chunk_size
+	// indices are handed out to the threads as they finish the previous one.
+	void parallelFor(
+		int begin,
+		int end,
+		int chunk_size,
+		const std::function<void(int, int)>& body);
+private:
+	ThreadPool(int n_threads, bool pin_threads);
+	void workerLoop(int thread);
+	void pinThread(int thread);
+
+	const int N_THREADS_;
+	const bool PIN_THREADS_;
+	std::vector<std::thread> workers_;
+	std::vector<int> cpus_; // CPUs the threads are pinned to
+
+	// Only one task at a time, other threads calling run() wait
+	std::mutex run_mutex_;
+	std::mutex mutex_;
+	std::condition_variable task_started_;
+	std::condition_variable task_finished_;
+	const std::function<void(int)>* task_;
+	unsigned long long generation_; // Number of tasks started
+	int n_running_; // Workers still running the current task
+	bool stop_;
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,74 @@
+#ifndef TILE_SCHEDULER_H
+#define TILE_SCHEDULER_H
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <functional>
+
+// Splits an image in to square tiles and renders them on the threads of the
+// thread pool. The tiles are put in a space filling order and each
+// thread starts with an equal, contiguous share of it, so its tiles are
+// close together in the image. A thread that runs out of tiles steals from
+// the end of the share of the thread with most tiles left.
+class TileScheduler
+{
+public:
+	enum Order
+	{
+		SCANLINE,
+		HILBERT, // Hilbert curve over the tile grid
+		SPIRAL, // From the center of the image outwards
+		N_ORDERS,
+	};
+	static const char* getOrderName(int order);
+
+	// Pixels [x0, x1) x [y0, y1)
+	struct Tile
+	{
+		int x0, y0;
+		int x1, y1;
+	};
+
+	TileScheduler(int width, int height, int tile_size, int order);
+	~TileScheduler(){};
+
+	// Calls render_tile(tile, thread) for every tile and returns when all
+	// are done. Busy time and tile counts are reset first. Without stealing
+	// every tile is given to the same thread in every run, which is used to
+	// let that thread touch the memory of the tile first.
+	void run(
+		const std::function<void(const Tile&, int)>& render_tile,
+		bool steal = true);
+
+	int getNumberOfTiles() const;
+	int getNumberOfThreads() const;
+	// Statistics of the last run
+	double getBusyTime(int thread) const; // Seconds spent rendering tiles
+	int getNumberOfRenderedTiles(int thread) const;
+	int getNumberOfStolenTiles(int thread) const;
+private:
+	// Tiles [begin, end) of the order that are left for one thread, padded
+	// so that threads do not share cache lines. Changed under the mutex but
+	// read without it when looking for a thread to steal from.
+	struct Queue
+	{
+		std::mutex mutex;
+		std::atomic<int> begin;
+		std::atomic<int> end;
+		double busy_time;
+		int n_rendered;
+		int n_stolen;
+		char padding[64];
+	};
+
+	void buildOrder(int n_tiles_x, int n_tiles_y, int order);
+	// Returns false when there are no tiles left for the thread, own or
+	// stolen
+	bool nextTile(int thread, bool steal, int* tile_index);
+
+	std::vector<Tile> tiles_;
+	std::vector<Queue> queues_;
+};
+
+#endif // TILE_SCHEDULER_H
@@ -0,0 +1,96 @@
+#ifndef WARP_H
+#define WARP_H
+
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+// Mappings from uniform samples in the unit square to directions and
+// points, and construction of a tangent frame around a normal.
+//
+// The kernels are inline and free of branches and calls to the math library
+// so that the batch versions, which work on arrays of floats, are
+// vectorized by the compiler.
+namespace warp
+{
+	// sin(x) and cos(x) for |x| <= pi / 4 as Taylor polynomials,
+	// both with an error below 4e-7 in that range
+	inline float sinQuarter(float x)
+	{
+		float x2 = x * x;
+		return x * (1 + x2 * (-1.0f / 6 + x2 * (1.0f / 120 + x2 * (-1.0f / 5040))));
+	}
+
+	inline float cosQuarter(float x)
+	{
+		float x2 = x * x;
+		return 1 + x2 * (-1.0f / 2 + x2 * (1.0f / 24 + x2 * (-1.0f / 720 + x2 * (1.0f / 40320))));
+	}
+
+	// Tangent and bitangent so that (t, b, n) is right handed and orthonormal.
+	// Duff et al. "Building an Orthonormal Basis, Revisited" (2017).
+	inline void buildOrthonormalBasis(glm::vec3 n, glm::vec3* t, glm::vec3* b)
+	{
+		float sign = std::copysign(1.0f, n.z);
+		float a = -1.0f / (sign + n.z);
+		float c = n.x * n.y * a;
+		*t = glm::vec3(1 + sign * n.x * n.x * a, sign * c, -sign * n.x);
+		*b = glm::vec3(c, sign + n.y * n.y * a, -n.y);
+	}
+
+	// Shirley and Chiu's area preserving map from the square to the unit
+	// disc. Only angles within pi / 4 of an axis are evaluated.
+	inline void squareToConcentricDisc(float u, float v, float* x, float* y)
+	{
+		float a = 2 * u - 1;
+		float b = 2 * v - 1;
+		bool horizontal = a * a > b * b;
+		float r = horizontal ? a : b;
+		float ratio = horizontal ? b : a;
+		// |ratio| <= |r|, so ratio is zero whenever r is
+		float angle = float(M_PI / 4) * ratio / (r != 0 ? r : 1);
+		float c = r * cosQuarter(angle);
+		float s = r * sinQuarter(angle);
+		*x = horizontal ? c : s;
+		*y = horizontal ? s : c;
+	}
+
+	// Density cos(theta) / pi around the z axis (Malley's method)
+	inline void squareToCosineHemisphere(float u, float v, float* x, float* y, float* z)
+	{
+		squareToConcentricDisc(u, v, x, y);
+		*z = std::sqrt(glm::max(0.0f, 1 - *x * *x - *y * *y));
+	}
+
+	inline glm::vec3 squareToCosineHemisphere(glm::vec2 sample)
+	{
+		glm::vec3 d;
+		squareToCosineHemisphere(sample.x, sample.y, &d.x, &d.y, &d.z);
+		return d;
+	}
+
+	// Cosine weighted direction around normal
+	inline glm::vec3 cosineHemisphere(glm::vec3 normal, glm::vec2 sample)
+	{
+		glm::vec3 t, b;
+		buildOrthonormalBasis(normal, &t, &b);
+		glm::vec3 d = squareToCosineHemisphere(sample);
+		return d.x * t + d.y * b + d.z * normal;
+	}
+
+	// Density 1 / (4 pi)
+	glm::vec3 squareToUniformSphere(glm::vec2 sample);
+
+	// Batch version of cosineHemisphere for n samples around the same
+	// normal. The inputs and outputs are separate arrays of components.
+	void cosineHemisphere(
+		glm::vec3 normal,
+		const float* u,
+		const float* v,
+		int n,
+		float* x,
+		float* y,
+		float* z);
+}
+
+#endif // WARP_H
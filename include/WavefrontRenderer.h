@@ -0,0 +1,148 @@
+#ifndef WAVEFRONT_RENDERER_H
+#define WAVEFRONT_RENDERER_H
+
+#include <vector>
+#include <functional>
+
+#include "Camera.h"
+#include "Scene.h"
+#include "Sampler.h"
+
+// Traces camera paths in batches, one stage at a time over the whole batch,
+// instead of one path at a time from start to end. Each bounce intersects
+// all paths, sorts the hits by the kind of surface, shades them group by
+// group, casts all shadow rays and continues with the new rays as the next
+// batch. The intersection code and the shading code of each kind of surface
+// then stay in the cache while they run, and the time of every stage can be
+// measured. The result is the same estimate as Scene::tracePath().
+class WavefrontRenderer
+{
+public:
+	enum Stage
+	{
+		GENERATE, // Camera rays
+		INTERSECT,
+		SORT, // Hits by surface kind
+		SHADE,
+		SHADOW, // Shadow rays of the diffuse vertices
+		ACCUMULATE, // Contributions to the pixels
+		N_STAGES,
+	};
+	static const char* getStageName(int stage);
+
+	WavefrontRenderer(
+		Scene* scene,
+		Camera* camera,
+		int sampler_type,
+		unsigned int seed,
+		int batch_size); // Camera paths in flight at a time
+	~WavefrontRenderer();
+
+	// Traces samples [first_sample, end_sample) of n_samples per pixel with
+	// render_mode. prepare_ray is called for every camera ray with its
+	// sample index, for example to set the weights of Scene::COMPOSITE.
+	void render(
+		int render_mode,
+		int first_sample,
+		int end_sample,
+		int n_samples,
+		const std::function<void(Ray*, int)>& prepare_ray =
+			std::function<void(Ray*, int)>());
+	// Sum over the samples of the last render, same unit as the value
+	// returned by Scene::tracePath() times the camera cosine
+	SpectralDistribution getRadianceSum(int index) const;
+	// Seconds spent in a stage during the last render
+	double getStageTime(int stage) const;
+	// Number of batches of the last render, one for every bounce of every
+	// group of camera paths
+	int getNumberOfBatches() const;
+private:
+	// A branch of a camera path. The random numbers of the branch continue
+	// at dimension of the sample of the pixel.
+	struct Path
+	{
+		Ray ray; // Radiance is the throughput, as in Scene::tracePath()
+		float weight; // Camera cosine
+		int pixel;
+		int sample;
+		unsigned int dimension;
+		int render_mode;
+		int iteration;
+	};
+
+	// What a path hit, in the order the groups are shaded
+	enum HitKind
+	{
+		MISS,
+		LAMP,
+		DIFFUSE,
+		SPECULAR,
+		TRANSMISSIVE,
+		MIXED, // Several of the above
+		N_HIT_KINDS,
+	};
+	struct Hit
+	{
+		int kind;
+		IntersectionData id;
+		LightSourceIntersectionData lamp_id;
+	};
+
+	struct PendingShadowRay
+	{
+		Scene::ShadowRay shadow_ray;
+		glm::vec3 direction_out;
+		IntersectionData id;
+		SpectralDistribution weight; // Path throughput times path weight
+		int pixel;
+	};
+
+	struct Contribution
+	{
+		int pixel;
+		SpectralDistribution radiance;
+	};
+
+	// Output of one thread during a stage, padded so that threads do not
+	// share cache lines
+	struct ThreadQueues
+	{
+		std::vector<Path> paths;
+		std::vector<PendingShadowRay> shadow_rays;
+		std::vector<Contribution> contributions;
+		char padding[64];
+	};
+
+	// Queues what Scene::shadeSurface() produces for one path
+	struct VertexSink;
+	// First dimension of the k:th branch started at a vertex of a path
+	static unsigned int getBranchDimension(unsigned int dimension, int k);
+
+	void generate(long first_path, long n_paths, int first_sample,
+		int n_samples, int render_mode, const std::function<void(Ray*, int)>& prepare_ray);
+	void intersect();
+	void sort();
+	void shade(int n_samples);
+	void traceShadowRays();
+	void accumulate();
+
+	Scene* scene_;
+	Camera* camera_;
+	const int SAMPLER_TYPE_;
+	const unsigned int SEED_;
+	const int BATCH_SIZE_;
+	// Branches start at a hashed multiple of this, so that the random
+	// numbers of the branches of a sample do not overlap
+	static const unsigned int BRANCH_DIMENSIONS = 1 << 10;
+
+	std::vector<Path> paths_;
+	std::vector<Hit> hits_;
+	std::vector<int> order_; // Indices in to paths_ sorted by hit kind
+	std::vector<ThreadQueues> queues_;
+	std::vector<Sampler*> samplers_; // One per thread of the pool
+	std::vector<SpectralDistribution> image_;
+	double stage_times_[N_STAGES];
+	int n_batches_;
+};
+
+#endif // WAVEFRONT_RENDERER_H
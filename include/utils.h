@@ -66,6 +66,15 @@ struct Ray
 	// When tracing from the camera, the radiance variable will be used for importance. 
 	SpectralDistribution radiance; // [Watts / m^2 / steradian]
 	bool has_intersected;  // This is used only when forward tracing ray
+	bool has_bounced_diffusely; // Set after the first diffuse bounce of the path
+	// Solid angle density of the direction if it was sampled from the diffuse
+	// brdf at the last vertex, zero after specular bounces and camera rays
+	float diffuse_pdf;
+	// Scene::COMPOSITE scales each part of the light transport along the
+	// path by these, zero leaves the part out
+	float emission_weight; // Lamps seen directly or through specular surfaces
+	float caustics_weight; // Caustic photons gathered before any diffuse bounce
+	float diffuse_weight; // Monte Carlo light from the first diffuse bounce on
 };
 
 struct Photon
@@ -76,23 +85,6 @@ struct Photon
 	static const float RADIUS;
 };
 
-struct KDTreeNode
-{
-	typedef double value_type;
-	Photon p;
-	size_t index;
-
-	value_type operator[](size_t n) const
-	{
-		return p.position[n];
-	}
-
-	double distance( const KDTreeNode &node)
-	{
-		return glm::length(node.p.position - p.position);
-	}
-};
-
 struct IntersectionData
 {
 	Material material; // Material of the object hit by the ray
@@ -100,12 +92,24 @@ struct IntersectionData
 	float t; // The distance the ray travelled before intersecting
 };
 
+// The first diffuse surface seen along a camera path.
+// Used for progressive photon mapping.
+struct VisiblePoint
+{
+	glm::vec3 position;
+	glm::vec3 normal; // Facing the side the camera path came from
+	glm::vec3 direction_out; // Towards the camera
+	Material material;
+	SpectralDistribution weight; // Importance of the camera path
+};
+
 struct LightSourceIntersectionData
 {
 	SpectralDistribution radiosity; // The radiosity of the light source [Watts/m^2]
 	float area; // The area of the light source [m^2]
 	glm::vec3 normal; // Normal of the surface hit by the ray
 	float t; // The distance the ray travelled before intersecting
+	float selection_probability; // Chance of the lamp being picked for a shadow ray
 };
 
 SpectralDistribution evaluatePerfectBRDF(
@@ -121,6 +125,16 @@ SpectralDistribution evaluateOrenNayarBRDF(
 	glm::vec3 normal,
 	SpectralDistribution albedo,
 	float roughness);
+// Multiple importance sampling weight of a sample from the strategy with
+// density pdf_a, when the other strategy has density pdf_b for the same
+// sample (Veach's power heuristic with exponent two)
+float powerHeuristic(float pdf_a, float pdf_b);
+// Oren-Nayar if the material has roughness, otherwise Lambertian
+SpectralDistribution evaluateDiffuseBRDF(
+	glm::vec3 d1,
+	glm::vec3 d2,
+	glm::vec3 normal,
+	const Material& material);
 
 
 #endif // UTILS_H
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include "../include/AccumulationBuffer.h"
+
+#include <new>
+#include <limits>
+
+namespace
+{
+	float luminance(const SpectralDistribution& sd)
+	{
+		return 0.2126f * sd.data[0] + 0.7152f * sd.data[1] + 0.0722f * sd.data[2];
+	}
+}
+
+AccumulationBuffer::AccumulationBuffer(int width, int height) :
+	WIDTH_(width),
+	HEIGHT_(height),
+	row_mutexes_(height)
+{
+	// Allocated untouched, see clear()
+	sums_ = static_cast<SpectralDistribution*>(
+		::operator new[](width * height * sizeof(SpectralDistribution)));
+	n_samples_ = new unsigned int[width * height];
+	square_sums_ = new float[width * height];
+	n_passes_ = new unsigned int[width * height];
+}
+
+AccumulationBuffer::~AccumulationBuffer()
+{
+	::operator delete[](sums_);
+	delete [] n_samples_;
+	delete [] square_sums_;
+	delete [] n_passes_;
+}
+
+void AccumulationBuffer::clear(int y, int x0, int x1)
+{
+	std::lock_guard<std::mutex> lock(row_mutexes_[y]);
+	for (int index = x0 + y * WIDTH_; index < x1 + y * WIDTH_; ++index)
+	{
+		new (&sums_[index]) SpectralDistribution();
+		n_samples_[index] = 0;
+		square_sums_[index] = 0;
+		n_passes_[index] = 0;
+	}
+}
+
+void AccumulationBuffer::add(
+	int y,
+	int x0,
+	int x1,
+	const SpectralDistribution* sums,
+	int n_samples)
+{
+	std::lock_guard<std::mutex> lock(row_mutexes_[y]);
+	for (int x = x0; x < x1; ++x)
+	{
+		float pass_luminance = luminance(sums[x - x0]);
+		sums_[x + y * WIDTH_] += sums[x - x0];
+		n_samples_[x + y * WIDTH_] += n_samples;
+		square_sums_[x + y * WIDTH_] += pass_luminance * pass_luminance / n_samples;
+		n_passes_[x + y * WIDTH_]++;
+	}
+}
+
+void AccumulationBuffer::add(const AccumulationBuffer& other)
+{
+	for (int y = 0; y < HEIGHT_; ++y)
+	{
+		std::lock_guard<std::mutex> lock(row_mutexes_[y]);
+		for (int index = y * WIDTH_; index < (y + 1) * WIDTH_; ++index)
+		{
+			sums_[index] += other.sums_[index];
+			n_samples_[index] += other.n_samples_[index];
+			square_sums_[index] += other.square_sums_[index];
+			n_passes_[index] += other.n_passes_[index];
+		}
+	}
+}
+
+SpectralDistribution AccumulationBuffer::getEstimate(int index) const
+{
+	if (!n_samples_[index])
+		return SpectralDistribution();
+	return sums_[index] / n_samples_[index];
+}
+
+unsigned int AccumulationBuffer::getNumberOfSamples(int index) const
+{
+	return n_samples_[index];
+}
+
+float AccumulationBuffer::getRelativeError(int index) const
+{
+	// The mean of a pass of n samples has a variance of sigma^2 / n, so
+	// n * (pass mean - mean)^2 summed over the passes estimates sigma^2
+	static const float MIN_LUMINANCE = 0.01;
+	unsigned int n_samples = n_samples_[index];
+	unsigned int n_passes = n_passes_[index];
+	if (n_passes < 2)
+		return std::numeric_limits<float>::infinity();
+	float mean = luminance(sums_[index]) / n_samples;
+	float variance = glm::max(
+		(square_sums_[index] - n_samples * mean * mean) / (n_passes - 1), 0.0f);
+	return sqrt(variance / n_samples) / glm::max(mean, MIN_LUMINANCE);
+}
+
+double AccumulationBuffer::getRelativeError() const
+{
+	double sum = 0;
+	for (int i = 0; i < WIDTH_ * HEIGHT_; ++i)
+	{
+		double error = getRelativeError(i);
+		sum += error * error;
+	}
+	return sqrt(sum / (WIDTH_ * HEIGHT_));
+}
+
+void AccumulationBuffer::snapshot(std::vector<SpectralDistribution>* estimate) const
+{
+	estimate->resize(WIDTH_ * HEIGHT_);
+	for (int y = 0; y < HEIGHT_; ++y)
+	{
+		std::lock_guard<std::mutex> lock(row_mutexes_[y]);
+		for (int index = y * WIDTH_; index < (y + 1) * WIDTH_; ++index)
+			(*estimate)[index] = getEstimate(index);
+	}
+}
+
+void AccumulationBuffer::write(std::ostream& os) const
+{
+	int size[] = {WIDTH_, HEIGHT_};
+	os.write(reinterpret_cast<const char*>(size), sizeof(size));
+	os.write(reinterpret_cast<const char*>(sums_), WIDTH_ * HEIGHT_ * sizeof(SpectralDistribution));
+	os.write(reinterpret_cast<const char*>(n_samples_), WIDTH_ * HEIGHT_ * sizeof(unsigned int));
+	os.write(reinterpret_cast<const char*>(square_sums_), WIDTH_ * HEIGHT_ * sizeof(float));
+	os.write(reinterpret_cast<const char*>(n_passes_), WIDTH_ * HEIGHT_ * sizeof(unsigned int));
+}
+
+bool AccumulationBuffer::read(std::istream& is)
+{
+	int size[2];
+	if (!is.read(reinterpret_cast<char*>(size), sizeof(size)) ||
+		size[0] != WIDTH_ || size[1] != HEIGHT_)
+		return false;
+	is.read(reinterpret_cast<char*>(sums_), WIDTH_ * HEIGHT_ * sizeof(SpectralDistribution));
+	is.read(reinterpret_cast<char*>(n_samples_), WIDTH_ * HEIGHT_ * sizeof(unsigned int));
+	is.read(reinterpret_cast<char*>(square_sums_), WIDTH_ * HEIGHT_ * sizeof(float));
+	is.read(reinterpret_cast<char*>(n_passes_), WIDTH_ * HEIGHT_ * sizeof(unsigned int));
+	return bool(is);
+}
+
+size_t AccumulationBuffer::getWrittenSize() const
+{
+	return 2 * sizeof(int) + size_t(WIDTH_) * HEIGHT_ *
+		(sizeof(SpectralDistribution) + 2 * sizeof(unsigned int) + sizeof(float));
+}
+
+int AccumulationBuffer::getWidth() const
+{
+	return WIDTH_;
+}
+
+int AccumulationBuffer::getHeight() const
+{
+	return HEIGHT_;
+}
@@ -0,0 +1,158 @@
+#include "../include/AdaptiveRenderer.h"
+#include "../include/ThreadPool.h"
+
+namespace
+{
+	float luminance(SpectralDistribution sd)
+	{
+		return 0.2126f * sd[0] + 0.7152f * sd[1] + 0.0722f * sd[2];
+	}
+}
+
+AdaptiveRenderer::AdaptiveRenderer(
+	Scene* scene,
+	Camera* camera,
+	int render_mode,
+	int sampler_type,
+	unsigned int seed,
+	int min_samples,
+	int max_samples,
+	float threshold) :
+	scene_(scene),
+	camera_(camera),
+	RENDER_MODE_(render_mode),
+	SAMPLER_TYPE_(sampler_type),
+	SEED_(seed),
+	// The variance needs at least two samples
+	MIN_SAMPLES_(glm::max(min_samples, 2)),
+	MAX_SAMPLES_(glm::max(max_samples, glm::max(min_samples, 2))),
+	THRESHOLD_(threshold),
+	n_rounds_(0),
+	pixels_(camera->WIDTH * camera->HEIGHT)
+{
+	for (int i = 0; i < pixels_.size(); ++i)
+	{
+		pixels_[i].n_samples = 0;
+		pixels_[i].m2 = 0;
+		pixels_[i].n_needed = MIN_SAMPLES_;
+	}
+}
+
+bool AdaptiveRenderer::renderRound()
+{
+	std::vector<int> active;
+	for (int i = 0; i < pixels_.size(); ++i)
+	{
+		if (pixels_[i].n_samples < pixels_[i].n_needed)
+			active.push_back(i);
+	}
+	if (active.empty())
+		return false;
+
+	glm::vec3 camera_plane_normal = glm::normalize(camera_->center - camera_->eye);
+
+	ThreadPool::instance().parallelFor(0, active.size(), 1, [&](int i, int thread)
+	{
+		int index = active[i];
+		PixelStatistics& pixel = pixels_[index];
+		// At most double the samples of the pixel each round, the variance
+		// estimate gets better on the way
+		int n_new = pixel.n_needed - pixel.n_samples;
+		if (pixel.n_samples)
+			n_new = glm::min(glm::max(n_new, MIN_SAMPLES_), pixel.n_samples);
+		n_new = glm::min(n_new, MAX_SAMPLES_ - pixel.n_samples);
+
+		int x = index % camera_->WIDTH;
+		int y = index / camera_->WIDTH;
+		// The number of samples is not known in advance, so samplers that
+		// need it fall back to independent samples
+		Sampler* sampler = Sampler::create(SAMPLER_TYPE_, SEED_);
+		for (int j = 0; j < n_new; ++j)
+		{
+			sampler->startSample(index, pixel.n_samples);
+			glm::vec2 jitter = sampler->next2D() - 0.5f;
+			Ray r = camera_->castRay(
+				x, // Pixel x
+				(camera_->HEIGHT - y - 1), // Pixel y
+				jitter.x, // Parameter x (>= -0.5 and < 0.5), for subsampling
+				jitter.y); // Parameter y (>= -0.5 and < 0.5), for subsampling
+			SpectralDistribution sd = scene_->tracePath(r, RENDER_MODE_, sampler) *
+				glm::dot(r.direction, camera_plane_normal);
+
+			// Welford's running mean and variance
+			pixel.n_samples++;
+			float delta = luminance(sd) - luminance(pixel.mean);
+			pixel.mean += (sd - pixel.mean) / pixel.n_samples;
+			pixel.m2 += delta * (luminance(sd) - luminance(pixel.mean));
+		}
+		delete sampler;
+	});
+	updateSamplesNeeded();
+	n_rounds_++;
+	return getNumberOfActivePixels() > 0;
+}
+
+void AdaptiveRenderer::updateSamplesNeeded()
+{
+	// Dark pixels are compared to a small floor instead of their mean, they
+	// would otherwise never converge
+	static const float MIN_LUMINANCE = 0.01;
+	std::vector<float> relative_variance(pixels_.size());
+	for (int i = 0; i < pixels_.size(); ++i)
+	{
+		const PixelStatistics& pixel = pixels_[i];
+		float mean = glm::max(luminance(pixel.mean), MIN_LUMINANCE);
+		relative_variance[i] = pixel.m2 / ((pixel.n_samples - 1) * mean * mean);
+	}
+
+	// A pixel with rare bright paths can look converged after a few samples
+	// that all missed them. Taking the largest variance of the neighbourhood
+	// makes such pixels keep sampling when their neighbours have found them.
+	int width = camera_->WIDTH;
+	int height = camera_->HEIGHT;
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			float variance = 0;
+			for (int j = glm::max(y - 1, 0); j <= glm::min(y + 1, height - 1); ++j)
+			{
+				for (int i = glm::max(x - 1, 0); i <= glm::min(x + 1, width - 1); ++i)
+					variance = glm::max(variance, relative_variance[i + j * width]);
+			}
+			double n = variance / (THRESHOLD_ * THRESHOLD_);
+			pixels_[x + y * width].n_needed = int(glm::min(n, double(MAX_SAMPLES_)) + 0.5);
+		}
+	}
+}
+
+SpectralDistribution AdaptiveRenderer::getRadiance(int index) const
+{
+	return pixels_[index].mean;
+}
+
+int AdaptiveRenderer::getNumberOfSamples(int index) const
+{
+	return pixels_[index].n_samples;
+}
+
+long AdaptiveRenderer::getTotalNumberOfSamples() const
+{
+	long n = 0;
+	for (int i = 0; i < pixels_.size(); ++i)
+		n += pixels_[i].n_samples;
+	return n;
+}
+
+int AdaptiveRenderer::getNumberOfActivePixels() const
+{
+	int n = 0;
+	for (int i = 0; i < pixels_.size(); ++i)
+		n += pixels_[i].n_samples < pixels_[i].n_needed;
+	return n;
+}
+
+int AdaptiveRenderer::getNumberOfRounds() const
+{
+	return n_rounds_;
+}
@@ -0,0 +1,75 @@
+#include "../include/AliasTable.h"
+
+void AliasTable::build(const std::vector<float>& weights)
+{
+	int n = weights.size();
+	bins_.resize(n);
+	if (!n)
+		return;
+
+	double sum = 0;
+	for (int i = 0; i < n; ++i)
+		sum += weights[i];
+
+	// Scaled so that the average bin is exactly full
+	std::vector<double> scaled(n);
+	std::vector<int> small;
+	std::vector<int> large;
+	for (int i = 0; i < n; ++i)
+	{
+		bins_[i].probability = sum > 0 ? weights[i] / sum : 1.0 / n;
+		scaled[i] = bins_[i].probability * n;
+		if (scaled[i] < 1)
+			small.push_back(i);
+		else
+			large.push_back(i);
+	}
+
+	// Fill up each under full bin with the remainder of an over full one
+	while (!small.empty() && !large.empty())
+	{
+		int s = small.back();
+		int l = large.back();
+		small.pop_back();
+		bins_[s].threshold = scaled[s];
+		bins_[s].alias = l;
+		scaled[l] = (scaled[l] + scaled[s]) - 1;
+		if (scaled[l] < 1)
+		{
+			large.pop_back();
+			small.push_back(l);
+		}
+	}
+	// What is left is full up to rounding errors
+	for (int i = 0; i < large.size(); ++i)
+	{
+		bins_[large[i]].threshold = 1;
+		bins_[large[i]].alias = large[i];
+	}
+	for (int i = 0; i < small.size(); ++i)
+	{
+		bins_[small[i]].threshold = 1;
+		bins_[small[i]].alias = small[i];
+	}
+}
+
+int AliasTable::sample(float u) const
+{
+	int n = bins_.size();
+	float scaled = u * n;
+	int i = int(scaled);
+	if (i > n - 1)
+		i = n - 1;
+	// The fraction within the bin decides between the index and its alias
+	return scaled - i < bins_[i].threshold ? i : bins_[i].alias;
+}
+
+float AliasTable::probability(int i) const
+{
+	return bins_[i].probability;
+}
+
+int AliasTable::size() const
+{
+	return bins_.size();
+}
@@ -80,6 +80,11 @@ Ray Camera::castRay(
 		r.radiance[0] = 1;
 		r.radiance[1] = 1;
 		r.radiance[2] = 1;
+		r.has_bounced_diffusely = false;
+		r.diffuse_pdf = 0;
+		r.emission_weight = 1;
+		r.caustics_weight = 1;
+		r.diffuse_weight = 1;
 	}
 	return r;
 }
\ No newline at end of file
@@ -0,0 +1,415 @@
+#include "../include/CompositeRenderer.h"
+
+#include <fstream>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+
+#include "../include/ThreadPool.h"
+
+static const char CHECKPOINT_MAGIC[4] = {'G', 'I', 'C', 'P'};
+static const unsigned int CHECKPOINT_VERSION = 2;
+
+// Weight of a part of the composite integrator that should only get budget
+// of the n_samples samples of a pixel. The samples are spread evenly and the
+// pattern repeats after n_samples / gcd(n_samples, budget) samples. Only a
+// whole number of these periods weighs the part correctly.
+static float componentWeight(int sample, int n_samples, int budget)
+{
+	if (!budget || (long(sample) * budget) % n_samples >= budget)
+		return 0;
+	return float(n_samples) / budget;
+}
+
+static int greatestCommonDivisor(int a, int b)
+{
+	while (b)
+	{
+		int r = a % b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
+
+// Samples after which the weights of all parts repeat
+static int weightPeriod(int n_samples, int specular_samples, int caustics_samples, int diffuse_samples)
+{
+	int budgets[] = {specular_samples, caustics_samples, diffuse_samples};
+	int period = 1;
+	for (int i = 0; i < 3; ++i)
+	{
+		if (!budgets[i])
+			continue;
+		int part_period = n_samples / greatestCommonDivisor(n_samples, budgets[i]);
+		period = period / greatestCommonDivisor(period, part_period) * part_period;
+	}
+	return period;
+}
+
+CompositeRenderer::CompositeRenderer(
+	Scene* scene,
+	Camera* camera,
+	const RenderSettings& settings,
+	int specular_samples,
+	int caustics_samples,
+	int diffuse_samples) :
+	scene_(scene),
+	camera_(camera),
+	SAMPLER_TYPE_(settings.sampler_type),
+	SPECULAR_SAMPLES_(specular_samples),
+	CAUSTICS_SAMPLES_(caustics_samples),
+	DIFFUSE_SAMPLES_(diffuse_samples),
+	N_SAMPLES_(glm::max(specular_samples, glm::max(caustics_samples, diffuse_samples))),
+	PERIOD_(N_SAMPLES_ ?
+		weightPeriod(N_SAMPLES_, specular_samples, caustics_samples, diffuse_samples) : 1),
+	// Rounded up to whole periods
+	PASS_SAMPLES_((glm::max(settings.pass_samples, 1) + PERIOD_ - 1) / PERIOD_ * PERIOD_),
+	UNLIMITED_SAMPLES_(settings.time_limit > 0 || settings.target_noise > 0),
+	TIME_LIMIT_(settings.time_limit),
+	TARGET_NOISE_(settings.target_noise),
+	scheduler_(camera->WIDTH, camera->HEIGHT, settings.tile_size, settings.tile_order),
+	wavefront_(NULL),
+	accumulation_(camera->WIDTH, camera->HEIGHT),
+	n_samples_done_(0),
+	n_passes_(0),
+	relative_error_(std::numeric_limits<double>::infinity()),
+	start_time_(std::chrono::steady_clock::now()),
+	render_time_(0),
+	n_timed_passes_(0),
+	busy_times_(scheduler_.getNumberOfThreads()),
+	n_rendered_tiles_(scheduler_.getNumberOfThreads()),
+	n_stolen_tiles_(scheduler_.getNumberOfThreads()),
+	n_batches_(0)
+{
+	if (settings.wavefront)
+	{
+		wavefront_ = new WavefrontRenderer(
+			scene,
+			camera,
+			SAMPLER_TYPE_,
+			Sampler::MONTE_CARLO_SEED,
+			settings.wavefront_batch_size);
+	}
+	for (int i = 0; i < WavefrontRenderer::N_STAGES; ++i)
+		stage_times_[i] = 0;
+
+	float parameters[] = {
+		float(camera->WIDTH), float(camera->HEIGHT),
+		camera->eye.x, camera->eye.y, camera->eye.z,
+		camera->center.x, camera->center.y, camera->center.z,
+		camera->up.x, camera->up.y, camera->up.z, camera->fov,
+		float(SAMPLER_TYPE_), float(Sampler::MONTE_CARLO_SEED),
+		float(SPECULAR_SAMPLES_), float(CAUSTICS_SAMPLES_), float(DIFFUSE_SAMPLES_),
+		float(settings.min_path_depth), float(settings.max_path_depth),
+		float(settings.first_bounce_splits), float(settings.stochastic_fresnel)};
+	parameters_.assign(parameters, parameters + sizeof(parameters) / sizeof(parameters[0]));
+
+	clear();
+}
+
+CompositeRenderer::~CompositeRenderer()
+{
+	delete wavefront_;
+}
+
+void CompositeRenderer::prepareRay(Ray* r, int sample) const
+{
+	r->emission_weight = componentWeight(sample, N_SAMPLES_, SPECULAR_SAMPLES_);
+	r->caustics_weight = componentWeight(sample, N_SAMPLES_, CAUSTICS_SAMPLES_);
+	r->diffuse_weight = componentWeight(sample, N_SAMPLES_, DIFFUSE_SAMPLES_);
+}
+
+bool CompositeRenderer::renderPass()
+{
+	if (!N_SAMPLES_ || isBudgetReached())
+		return false;
+	int end_sample = n_samples_done_ + PASS_SAMPLES_;
+	if (!UNLIMITED_SAMPLES_)
+		end_sample = glm::min(end_sample, N_SAMPLES_);
+	renderSamples(n_samples_done_, end_sample);
+	return true;
+}
+
+bool CompositeRenderer::isBudgetReached() const
+{
+	if (!UNLIMITED_SAMPLES_)
+		return n_samples_done_ >= N_SAMPLES_;
+	if (TARGET_NOISE_ > 0 && relative_error_ <= TARGET_NOISE_)
+		return true;
+	if (TIME_LIMIT_ > 0 && n_timed_passes_)
+	{
+		double elapsed = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - start_time_).count();
+		return elapsed + render_time_ / n_timed_passes_ > TIME_LIMIT_;
+	}
+	return false;
+}
+
+void CompositeRenderer::setStartTime(std::chrono::steady_clock::time_point start_time)
+{
+	start_time_ = start_time;
+}
+
+void CompositeRenderer::renderSamples(int first_sample, int end_sample)
+{
+	std::chrono::steady_clock::time_point pass_start = std::chrono::steady_clock::now();
+	if (wavefront_)
+	{
+		wavefront_->render(Scene::COMPOSITE, first_sample, end_sample, N_SAMPLES_,
+			[&](Ray* r, int sample) { prepareRay(r, sample); });
+		std::vector<SpectralDistribution> sums(camera_->WIDTH);
+		for (int y = 0; y < camera_->HEIGHT; ++y)
+		{
+			for (int x = 0; x < camera_->WIDTH; ++x)
+				sums[x] = wavefront_->getRadianceSum(x + y * camera_->WIDTH) * (2 * M_PI);
+			accumulation_.add(y, 0, camera_->WIDTH, &sums[0], end_sample - first_sample);
+		}
+		for (int i = 0; i < WavefrontRenderer::N_STAGES; ++i)
+			stage_times_[i] += wavefront_->getStageTime(i);
+		n_batches_ += wavefront_->getNumberOfBatches();
+	}
+	else
+	{
+		scheduler_.run([&](const TileScheduler::Tile& tile, int thread)
+		{
+			renderTile(tile, first_sample, end_sample);
+		});
+		for (int i = 0; i < scheduler_.getNumberOfThreads(); ++i)
+		{
+			busy_times_[i] += scheduler_.getBusyTime(i);
+			n_rendered_tiles_[i] += scheduler_.getNumberOfRenderedTiles(i);
+			n_stolen_tiles_[i] += scheduler_.getNumberOfStolenTiles(i);
+		}
+	}
+	n_samples_done_ += end_sample - first_sample;
+	n_passes_++;
+	relative_error_ = accumulation_.getRelativeError();
+	render_time_ += std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - pass_start).count();
+	n_timed_passes_++;
+}
+
+void CompositeRenderer::addSamples(const AccumulationBuffer& samples, int n_samples, double render_time)
+{
+	accumulation_.add(samples);
+	n_samples_done_ += n_samples;
+	n_passes_++;
+	relative_error_ = accumulation_.getRelativeError();
+	render_time_ += render_time;
+	n_timed_passes_++;
+}
+
+void CompositeRenderer::clear()
+{
+	// Tiles are zeroed by the threads that are likely to render them, which
+	// places the memory pages on their NUMA nodes. Rows of a tile are
+	// shorter than a page and tiles are stolen, so the memory is mostly but
+	// not all local to the thread that renders it.
+	scheduler_.run([&](const TileScheduler::Tile& tile, int thread)
+	{
+		for (int y = tile.y0; y < tile.y1; ++y)
+			accumulation_.clear(y, tile.x0, tile.x1);
+	}, false);
+	n_samples_done_ = 0;
+	n_passes_ = 0;
+	relative_error_ = std::numeric_limits<double>::infinity();
+}
+
+const std::vector<float>& CompositeRenderer::getParameters() const
+{
+	return parameters_;
+}
+
+void CompositeRenderer::renderTile(
+	const TileScheduler::Tile& tile,
+	int first_sample,
+	int end_sample)
+{
+	glm::vec3 camera_plane_normal = glm::normalize(camera_->center - camera_->eye);
+	// Random numbers only depend on pixel, sample and dimension
+	Sampler* sampler = Sampler::create(SAMPLER_TYPE_, Sampler::MONTE_CARLO_SEED);
+	std::vector<SpectralDistribution> sums(tile.x1 - tile.x0);
+	for (int y = tile.y0; y < tile.y1; ++y)
+	{
+		for (int x = tile.x0; x < tile.x1; ++x)
+		{
+			int index = (x + y * camera_->WIDTH);
+			SpectralDistribution sd;
+			for (int i = first_sample; i < end_sample; ++i)
+			{
+				sampler->startSample(index, i, N_SAMPLES_);
+				glm::vec2 jitter = sampler->next2D() - 0.5f;
+				Ray r = camera_->castRay(
+					x, // Pixel x
+					(camera_->HEIGHT - y - 1), // Pixel y
+					jitter.x, // Parameter x (>= -0.5 and < 0.5), for subsampling
+					jitter.y); // Parameter y (>= -0.5 and < 0.5), for subsampling
+				prepareRay(&r, i);
+				sd += scene_->tracePath(r, Scene::COMPOSITE, sampler) *
+					glm::dot(r.direction, camera_plane_normal);
+			}
+			sums[x - tile.x0] = sd * (2 * M_PI);
+		}
+		accumulation_.add(y, tile.x0, tile.x1, &sums[0], end_sample - first_sample);
+	}
+	delete sampler;
+}
+
+bool CompositeRenderer::saveCheckpoint(const char* file_path, int n_photons)
+{
+	std::string temporary_file_path = std::string(file_path) + ".tmp";
+	{
+		std::ofstream file(temporary_file_path.c_str(), std::ios::binary);
+		if (!file)
+		{
+			std::cout << "Could not open " << temporary_file_path << " for writing." << std::endl;
+			return false;
+		}
+		int n_parameters = parameters_.size();
+		file.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+		file.write(reinterpret_cast<const char*>(&CHECKPOINT_VERSION), sizeof(CHECKPOINT_VERSION));
+		file.write(reinterpret_cast<const char*>(&n_parameters), sizeof(n_parameters));
+		file.write(reinterpret_cast<const char*>(&parameters_[0]),
+			n_parameters * sizeof(float));
+		file.write(reinterpret_cast<const char*>(&n_samples_done_), sizeof(n_samples_done_));
+		file.write(reinterpret_cast<const char*>(&n_passes_), sizeof(n_passes_));
+		accumulation_.write(file);
+		if (n_photons > 0)
+			scene_->writePhotonMap(file, n_photons);
+		if (!file)
+		{
+			std::cout << "Could not write checkpoint to " << temporary_file_path << "." << std::endl;
+			return false;
+		}
+	}
+	if (rename(temporary_file_path.c_str(), file_path) != 0)
+	{
+		std::cout << "Could not rename " << temporary_file_path << " to " << file_path << "." << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool CompositeRenderer::loadCheckpoint(const char* file_path, int n_photons)
+{
+	std::ifstream file(file_path, std::ios::binary);
+	if (!file)
+	{
+		std::cout << "Could not open " << file_path << "." << std::endl;
+		return false;
+	}
+	char magic[sizeof(CHECKPOINT_MAGIC)];
+	unsigned int version;
+	int n_parameters;
+	file.read(magic, sizeof(magic));
+	file.read(reinterpret_cast<char*>(&version), sizeof(version));
+	file.read(reinterpret_cast<char*>(&n_parameters), sizeof(n_parameters));
+	if (!file ||
+		!std::equal(magic, magic + sizeof(magic), CHECKPOINT_MAGIC) ||
+		version != CHECKPOINT_VERSION ||
+		n_parameters != parameters_.size())
+	{
+		std::cout << file_path << " is not a checkpoint of this version." << std::endl;
+		return false;
+	}
+	std::vector<float> parameters(n_parameters);
+	file.read(reinterpret_cast<char*>(&parameters[0]), n_parameters * sizeof(float));
+	if (!file || parameters != parameters_)
+	{
+		std::cout << "Checkpoint in " << file_path <<
+			" was rendered with another camera or other settings." << std::endl;
+		return false;
+	}
+	int n_samples_done;
+	int n_passes;
+	file.read(reinterpret_cast<char*>(&n_samples_done), sizeof(n_samples_done));
+	file.read(reinterpret_cast<char*>(&n_passes), sizeof(n_passes));
+	if (!file || !accumulation_.read(file) ||
+		(n_photons > 0 && !scene_->readPhotonMap(file, n_photons)))
+	{
+		std::cout << "Could not read checkpoint from " << file_path << "." << std::endl;
+		return false;
+	}
+	if (n_samples_done % PERIOD_)
+	{
+		std::cout << "Checkpoint in " << file_path << " does not end at a whole period of " <<
+			PERIOD_ << " samples per pixel and can not be continued." << std::endl;
+		return false;
+	}
+	n_samples_done_ = n_samples_done;
+	n_passes_ = n_passes;
+	relative_error_ = accumulation_.getRelativeError();
+	return true;
+}
+
+int CompositeRenderer::getNumberOfSamples() const
+{
+	return n_samples_done_;
+}
+
+int CompositeRenderer::getTotalNumberOfSamples() const
+{
+	return N_SAMPLES_;
+}
+
+int CompositeRenderer::getPassSamples() const
+{
+	return PASS_SAMPLES_;
+}
+
+int CompositeRenderer::getWeightPeriod() const
+{
+	return PERIOD_;
+}
+
+bool CompositeRenderer::hasSampleLimit() const
+{
+	return !UNLIMITED_SAMPLES_;
+}
+
+int CompositeRenderer::getNumberOfPasses() const
+{
+	return n_passes_;
+}
+
+double CompositeRenderer::getRelativeError() const
+{
+	return relative_error_;
+}
+
+const AccumulationBuffer& CompositeRenderer::getAccumulationBuffer() const
+{
+	return accumulation_;
+}
+
+int CompositeRenderer::getNumberOfThreads() const
+{
+	return scheduler_.getNumberOfThreads();
+}
+
+double CompositeRenderer::getBusyTime(int thread) const
+{
+	return busy_times_[thread];
+}
+
+int CompositeRenderer::getNumberOfRenderedTiles(int thread) const
+{
+	return n_rendered_tiles_[thread];
+}
+
+int CompositeRenderer::getNumberOfStolenTiles(int thread) const
+{
+	return n_stolen_tiles_[thread];
+}
+
+double CompositeRenderer::getStageTime(int stage) const
+{
+	return stage_times_[stage];
+}
+
+int CompositeRenderer::getNumberOfBatches() const
+{
+	return n_batches_;
+}
@@ -0,0 +1,48 @@
+#include "../include/ImageIO.h"
+
+#include <stdio.h>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace image_io
+{
+	int savePPM(
+		const char* file_name,
+		const int width,
+		const int height,
+		unsigned char* data)
+	{
+		FILE *fp = fopen(file_name, "wb"); // b - binary mode
+		if (!fp)
+			return EXIT_FAILURE;
+		fprintf(fp, "P6\n%d %d\n255\n", width, height);
+		fwrite(data, 1, width * height * 3, fp);
+		fclose(fp);
+		return EXIT_SUCCESS;
+	}
+
+	void toneMap(SpectralDistribution radiance, float gamma, unsigned char* rgb)
+	{
+		for (int i = 0; i < 3; ++i)
+			rgb[i] = char(int(glm::clamp(glm::pow(radiance[i], gamma), 0.0f, 1.0f) * 255));
+	}
+
+	bool saveEstimate(const char* file_name, const AccumulationBuffer& accumulation, float gamma)
+	{
+		std::vector<SpectralDistribution> estimate;
+		accumulation.snapshot(&estimate);
+		std::vector<unsigned char> data(estimate.size() * 3);
+		for (int i = 0; i < estimate.size(); ++i)
+			toneMap(estimate[i], gamma, &data[i * 3]);
+		std::string temporary_file_name = std::string(file_name) + ".tmp";
+		int result = savePPM(
+			temporary_file_name.c_str(),
+			accumulation.getWidth(),
+			accumulation.getHeight(),
+			&data[0]);
+		if (result != EXIT_SUCCESS)
+			return false;
+		return rename(temporary_file_name.c_str(), file_name) == 0;
+	}
+}
@@ -2,8 +2,8 @@
 
 #include "../external_libraries/common_include/objloader.h"
 #include "../external_libraries/common_include/vboindexer.h"
+#include "../include/Warp.h"
 
-#include <random>
 #include <iostream>
 
 #include <glm/glm.hpp>
@@ -141,18 +141,7 @@ bool Sphere::intersect(IntersectionData* id, Ray r) const
 glm::vec3 Sphere::getPointOnSurface(float u, float v) const
 {
 	// Uniform over a sphere
-	float inclination = glm::acos(1 - 2 * u);
-	float azimuth = 2 * M_PI * v;
-
-	glm::vec3 random_direction = glm::vec3(1,0,0);
-	random_direction = glm::normalize(glm::rotate(
-		random_direction,
-		inclination,
-		glm::vec3(0,1,0)));
-	random_direction = glm::normalize(glm::rotate(
-		random_direction,
-		azimuth,
-		glm::vec3(1,0,0)));
+	glm::vec3 random_direction = warp::squareToUniformSphere(glm::vec2(u, v));
 
 	return POSITION_ + random_direction * RADIUS_;
 }
@@ -276,39 +265,24 @@ glm::vec3 LightSource::getNormal() const
 	return emitter_.getNormal();
 }
 
-Ray LightSource::shootLightRay()
+Ray LightSource::shootLightRay(Sampler* sampler)
 {
-	// Move random code out later
-	std::random_device rd;
-	std::mt19937 gen(rd());
-	std::uniform_real_distribution<float> dis(0, 1);
-
 	Ray r;
-	r.origin = getPointOnSurface(dis(gen), dis(gen));
-
-	// Get a uniformly distributed vector
-	glm::vec3 normal = emitter_.getNormal();
-	glm::vec3 tangent = emitter_.getFirstTangent();
-	// rand1 is a random number from the cosine estimator
-	float rand1 = dis(gen);//glm::asin(dis(gen));// (*dis_)(*gen_);
-	float rand2 = dis(gen);
-
-	// Uniform distribution
-	float inclination = acos(sqrt(rand1));//glm::acos(1 - rand1);//glm::acos(1 -  2 * (*dis_)(*gen_));
-	float azimuth = 2 * M_PI * rand2;
-	// Change the actual vector
-	glm::vec3 random_direction = normal;
-	random_direction = glm::normalize(glm::rotate(
-		random_direction,
-		inclination,
-		tangent));
-	random_direction = glm::normalize(glm::rotate(
-		random_direction,
-		azimuth,
-		normal));
+	glm::vec2 position_sample = sampler->next2D();
+	r.origin = getPointOnSurface(position_sample.x, position_sample.y);
+
+	// Cosine distributed direction, the lamp is a lambertian emitter
+	glm::vec3 random_direction = warp::cosineHemisphere(
+		emitter_.getNormal(),
+		sampler->next2D());
 
 	r.direction = random_direction;
 	r.material = Material::air();
+	r.has_bounced_diffusely = false;
+	r.diffuse_pdf = 0;
+	r.emission_weight = 1;
+	r.caustics_weight = 1;
+	r.diffuse_weight = 1;
 	
 	return r;
 }
\ No newline at end of file
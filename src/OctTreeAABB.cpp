@@ -1,5 +1,6 @@
 #include "../include/OctTreeAABB.h"
 #include "../include/Object3D.h"
+#include "../include/ThreadPool.h"
 
 #include "../external_libraries/common_include/boxOverlap.h"
 
@@ -103,10 +104,12 @@ OctNodeAABB::OctNodeAABB(
 	}
 	else
 	{ // Continue recursion, create more children
-		glm::vec3 child_aabb_min;
-		glm::vec3 child_aabb_max;
-		for (int i = 0; i < 8; ++i)
+		// The subtrees of the root are built in parallel, they only read the
+		// triangles of the root
+		auto build_child = [&](int i, int thread)
 		{
+			glm::vec3 child_aabb_min;
+			glm::vec3 child_aabb_max;
 			child_aabb_min = glm::vec3(
 				i%2 	== 0 ? aabb_min.x : (aabb_min.x + aabb_max.x) / 2,
 				(i/2)%2 == 0 ? aabb_min.y : (aabb_min.y + aabb_max.y) / 2,
@@ -121,6 +124,13 @@ OctNodeAABB::OctNodeAABB(
 				mesh,
 				child_aabb_min,
 				child_aabb_max);
+		};
+		if (!parent)
+			ThreadPool::instance().parallelFor(0, 8, 1, build_child);
+		else
+		{
+			for (int i = 0; i < 8; ++i)
+				build_child(i, 0);
 		}
 	}
 }
@@ -0,0 +1,341 @@
+#include "../include/PhotonMap.h"
+
+#include <algorithm>
+#include <cmath>
+
+// --- Lookup tables used for decoding compact photons --- //
+
+namespace
+{
+	struct DecodeTables
+	{
+		float cos_theta[256];
+		float sin_theta[256];
+		float cos_phi[256];
+		float sin_phi[256];
+		float exponent[256]; // 2^(e - 128 - 8)
+
+		DecodeTables()
+		{
+			for (int i = 0; i < 256; ++i)
+			{
+				// Use the center of each quantization interval
+				float theta = (i + 0.5) * (M_PI / 256);
+				float phi = (i + 0.5) * (2 * M_PI / 256);
+				cos_theta[i] = cos(theta);
+				sin_theta[i] = sin(theta);
+				cos_phi[i] = cos(phi);
+				sin_phi[i] = sin(phi);
+				exponent[i] = ldexp(1.0, i - (128 + 8));
+			}
+		}
+	};
+
+	const DecodeTables tables;
+}
+
+// --- CompactPhoton functions --- //
+
+static_assert(sizeof(CompactPhoton) == 20, "CompactPhoton should be 20 bytes");
+
+void CompactPhoton::encode(const Photon& p)
+{
+	static_assert(
+		SpectralDistribution::N_WAVELENGTHS == 3,
+		"Shared exponent encoding assumes three wavelengths");
+
+	position = p.position;
+	plane = 0;
+
+	glm::vec3 d = glm::normalize(p.direction_in);
+	int theta_i = int(acos(glm::clamp(d.z, -1.0f, 1.0f)) * (256 / M_PI));
+	float phi_f = atan2(d.y, d.x);
+	if (phi_f < 0)
+		phi_f += 2 * M_PI;
+	int phi_i = int(phi_f * (256 / (2 * M_PI)));
+	theta = glm::clamp(theta_i, 0, 255);
+	phi = phi_i & 255;
+
+	setDeltaFlux(p.delta_flux);
+}
+
+void CompactPhoton::setDeltaFlux(SpectralDistribution delta_flux)
+{
+	// Ward's rgbe, the largest channel decides the exponent
+	float r = glm::max(delta_flux.data[0], 0.0f);
+	float g = glm::max(delta_flux.data[1], 0.0f);
+	float b = glm::max(delta_flux.data[2], 0.0f);
+	float v = glm::max(r, glm::max(g, b));
+	if (v < 1e-32)
+	{
+		flux[0] = flux[1] = flux[2] = flux[3] = 0;
+	}
+	else
+	{
+		int e;
+		float scale = frexp(v, &e) * 256.0 / v;
+		flux[0] = (unsigned char)(r * scale);
+		flux[1] = (unsigned char)(g * scale);
+		flux[2] = (unsigned char)(b * scale);
+		flux[3] = (unsigned char)(e + 128);
+	}
+}
+
+glm::vec3 CompactPhoton::direction() const
+{
+	return glm::vec3(
+		tables.sin_theta[theta] * tables.cos_phi[phi],
+		tables.sin_theta[theta] * tables.sin_phi[phi],
+		tables.cos_theta[theta]);
+}
+
+SpectralDistribution CompactPhoton::deltaFlux() const
+{
+	SpectralDistribution sd;
+	if (flux[3])
+	{
+		float f = tables.exponent[flux[3]];
+		sd.data[0] = (flux[0] + 0.5f) * f;
+		sd.data[1] = (flux[1] + 0.5f) * f;
+		sd.data[2] = (flux[2] + 0.5f) * f;
+	}
+	return sd;
+}
+
+// --- PhotonMap class functions --- //
+
+PhotonMap::PhotonMap()
+{}
+
+void PhotonMap::store(const Photon& p, unsigned long long sort_key)
+{
+	CompactPhoton cp;
+	cp.encode(p);
+	std::lock_guard<std::mutex> lock(store_mutex_);
+	photons_.push_back(cp);
+	sort_keys_.push_back(sort_key);
+}
+
+void PhotonMap::clear()
+{
+	std::vector<CompactPhoton>().swap(photons_);
+	std::vector<unsigned long long>().swap(sort_keys_);
+}
+
+void PhotonMap::balance()
+{
+	if (sort_keys_.size() == photons_.size())
+	{
+		std::vector<int> order(photons_.size());
+		for (int i = 0; i < order.size(); ++i)
+			order[i] = i;
+		std::sort(order.begin(), order.end(), [this](int a, int b) {
+			return sort_keys_[a] < sort_keys_[b];
+		});
+		std::vector<CompactPhoton> sorted(photons_.size());
+		for (int i = 0; i < order.size(); ++i)
+			sorted[i] = photons_[order[i]];
+		photons_.swap(sorted);
+	}
+	std::vector<unsigned long long>().swap(sort_keys_);
+
+	// Release the slack from the growth of the vector
+	photons_.shrink_to_fit();
+	balanceSegment(0, photons_.size());
+}
+
+void PhotonMap::balanceSegment(int begin, int end)
+{
+	if (end - begin < 2)
+		return;
+
+	// Split along the axis where the segment has the largest extent
+	glm::vec3 min = photons_[begin].position;
+	glm::vec3 max = photons_[begin].position;
+	for (int i = begin + 1; i < end; ++i)
+	{
+		min = glm::min(min, photons_[i].position);
+		max = glm::max(max, photons_[i].position);
+	}
+	glm::vec3 extent = max - min;
+	short axis = 0;
+	if (extent.y > extent[axis])
+		axis = 1;
+	if (extent.z > extent[axis])
+		axis = 2;
+
+	int median = begin + (end - begin) / 2;
+	std::nth_element(
+		photons_.begin() + begin,
+		photons_.begin() + median,
+		photons_.begin() + end,
+		[axis](const CompactPhoton& a, const CompactPhoton& b) {
+			return a.position[axis] < b.position[axis];
+		});
+	photons_[median].plane = axis;
+
+	balanceSegment(begin, median);
+	balanceSegment(median + 1, end);
+}
+
+void PhotonMap::findWithinRange(
+	glm::vec3 position,
+	float radius,
+	std::vector<const CompactPhoton*>* photons) const
+{
+	locatePhotons(0, photons_.size(), position, radius * radius, photons);
+}
+
+void PhotonMap::locatePhotons(
+	int begin,
+	int end,
+	glm::vec3 position,
+	float radius_squared,
+	std::vector<const CompactPhoton*>* photons) const
+{
+	if (begin >= end)
+		return;
+	int median = begin + (end - begin) / 2;
+	const CompactPhoton& p = photons_[median];
+
+	// Search the side of the splitting plane where the position is first,
+	// the other side only if the sphere crosses the plane
+	float delta = position[p.plane] - p.position[p.plane];
+	if (delta < 0)
+	{
+		locatePhotons(begin, median, position, radius_squared, photons);
+		if (delta * delta < radius_squared)
+			locatePhotons(median + 1, end, position, radius_squared, photons);
+	}
+	else
+	{
+		locatePhotons(median + 1, end, position, radius_squared, photons);
+		if (delta * delta < radius_squared)
+			locatePhotons(begin, median, position, radius_squared, photons);
+	}
+
+	glm::vec3 difference = p.position - position;
+	if (glm::dot(difference, difference) < radius_squared)
+		photons->push_back(&p);
+}
+
+const CompactPhoton* PhotonMap::findNearest(
+	glm::vec3 position,
+	glm::vec3 normal,
+	float max_distance) const
+{
+	float distance_squared = max_distance * max_distance;
+	const CompactPhoton* nearest = NULL;
+	locateNearest(0, photons_.size(), position, normal, &distance_squared, &nearest);
+	return nearest;
+}
+
+void PhotonMap::locateNearest(
+	int begin,
+	int end,
+	glm::vec3 position,
+	glm::vec3 normal,
+	float* distance_squared,
+	const CompactPhoton** nearest) const
+{
+	if (begin >= end)
+		return;
+	int median = begin + (end - begin) / 2;
+	const CompactPhoton& p = photons_[median];
+
+	// The search radius shrinks as closer photons are found
+	float delta = position[p.plane] - p.position[p.plane];
+	if (delta < 0)
+	{
+		locateNearest(begin, median, position, normal, distance_squared, nearest);
+		if (delta * delta < *distance_squared)
+			locateNearest(median + 1, end, position, normal, distance_squared, nearest);
+	}
+	else
+	{
+		locateNearest(median + 1, end, position, normal, distance_squared, nearest);
+		if (delta * delta < *distance_squared)
+			locateNearest(begin, median, position, normal, distance_squared, nearest);
+	}
+
+	glm::vec3 difference = p.position - position;
+	float d2 = glm::dot(difference, difference);
+	if (d2 < *distance_squared && glm::dot(p.direction(), normal) > 0.9)
+	{
+		*distance_squared = d2;
+		*nearest = &p;
+	}
+}
+
+SpectralDistribution PhotonMap::estimateIrradiance(
+	glm::vec3 position,
+	glm::vec3 normal,
+	float radius) const
+{
+	// Reused by each thread, and allocated by it so it is in its own memory
+	thread_local std::vector<const CompactPhoton*> photons;
+	photons.clear();
+	findWithinRange(position, radius, &photons);
+
+	SpectralDistribution flux;
+	for (int i = 0; i < photons.size(); ++i)
+	{
+		if (glm::dot(photons[i]->direction(), normal) > 0)
+			flux += photons[i]->deltaFlux();
+	}
+	return flux / (radius * radius * M_PI);
+}
+
+void PhotonMap::write(std::ostream& os) const
+{
+	unsigned long long n_photons = photons_.size();
+	os.write(reinterpret_cast<const char*>(&n_photons), sizeof(n_photons));
+	os.write(
+		reinterpret_cast<const char*>(photons_.data()),
+		n_photons * sizeof(CompactPhoton));
+}
+
+bool PhotonMap::read(std::istream& is)
+{
+	unsigned long long n_photons;
+	if (!is.read(reinterpret_cast<char*>(&n_photons), sizeof(n_photons)))
+		return false;
+	// A broken file must not make us allocate more photons than the rest of
+	// it holds. Streams that can not seek are not checked.
+	std::streampos position = is.tellg();
+	if (position != std::streampos(-1))
+	{
+		is.seekg(0, std::ios::end);
+		unsigned long long remaining = is.tellg() - position;
+		is.seekg(position);
+		if (!is || n_photons > remaining / sizeof(CompactPhoton))
+		{
+			clear();
+			return false;
+		}
+	}
+	photons_.resize(n_photons);
+	if (!is.read(
+		reinterpret_cast<char*>(photons_.data()),
+		n_photons * sizeof(CompactPhoton)))
+	{
+		clear();
+		return false;
+	}
+	return true;
+}
+
+CompactPhoton& PhotonMap::operator[](const int i)
+{
+	return photons_[i];
+}
+
+int PhotonMap::size() const
+{
+	return photons_.size();
+}
+
+size_t PhotonMap::memoryUsage() const
+{
+	return photons_.capacity() * sizeof(CompactPhoton);
+}
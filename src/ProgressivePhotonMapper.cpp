@@ -0,0 +1,84 @@
+#include "../include/ProgressivePhotonMapper.h"
+#include "../include/ThreadPool.h"
+
+ProgressivePhotonMapper::ProgressivePhotonMapper(
+	Scene* scene,
+	Camera* camera,
+	int photons_per_pass,
+	float initial_radius,
+	float alpha) :
+	scene_(scene),
+	camera_(camera),
+	PHOTONS_PER_PASS_(photons_per_pass),
+	ALPHA_(alpha),
+	n_passes_(0),
+	pixels_(camera->WIDTH * camera->HEIGHT)
+{
+	for (int i = 0; i < pixels_.size(); ++i)
+	{
+		pixels_[i].radius = initial_radius;
+		pixels_[i].n_photons = 0;
+	}
+}
+
+void ProgressivePhotonMapper::renderPass()
+{
+	scene_->buildProgressivePhotonMap(PHOTONS_PER_PASS_, n_passes_);
+
+	glm::vec3 camera_plane_normal = glm::normalize(camera_->center - camera_->eye);
+
+	ThreadPool::instance().parallelFor(0, pixels_.size(), 64, [&](int index, int thread)
+	{
+		IndependentSampler sampler(Sampler::PROGRESSIVE_SEED);
+		sampler.startSample(index, n_passes_);
+
+		int x = index % camera_->WIDTH;
+		int y = index / camera_->WIDTH;
+		glm::vec2 jitter = sampler.next2D() - 0.5f;
+		Ray r = camera_->castRay(
+			x, // Pixel x
+			(camera_->HEIGHT - y - 1), // Pixel y
+			jitter.x, // Parameter x (>= -0.5 and < 0.5), for subsampling
+			jitter.y); // Parameter y (>= -0.5 and < 0.5), for subsampling
+
+		VisiblePoint vp;
+		if (!scene_->traceVisiblePoint(r, &sampler, &vp))
+			return;
+
+		PixelStatistics& pixel = pixels_[index];
+		int n_new;
+		SpectralDistribution flux = scene_->gatherPhotons(vp, pixel.radius, &n_new);
+		if (!n_new)
+			return;
+
+		// Only a fraction alpha of the new photons are added to the count,
+		// the radius shrinks so that the photon density is kept
+		float n_photons = pixel.n_photons + ALPHA_ * n_new;
+		float radius = pixel.radius * sqrt(n_photons / (pixel.n_photons + n_new));
+		float area_ratio = (radius * radius) / (pixel.radius * pixel.radius);
+		pixel.flux = (pixel.flux + flux * vp.weight * glm::dot(r.direction, camera_plane_normal)) *
+			area_ratio;
+		pixel.radius = radius;
+		pixel.n_photons = n_photons;
+	});
+	n_passes_++;
+}
+
+SpectralDistribution ProgressivePhotonMapper::getRadiance(int index) const
+{
+	if (!n_passes_)
+		return SpectralDistribution();
+	const PixelStatistics& pixel = pixels_[index];
+	// Each pass emits the total flux of the scene
+	return pixel.flux / (pixel.radius * pixel.radius * M_PI * n_passes_);
+}
+
+int ProgressivePhotonMapper::getNumberOfPasses() const
+{
+	return n_passes_;
+}
+
+long ProgressivePhotonMapper::getNumberOfEmittedPhotons() const
+{
+	return long(n_passes_) * PHOTONS_PER_PASS_;
+}
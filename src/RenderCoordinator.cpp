@@ -0,0 +1,280 @@
+#include "../include/RenderCoordinator.h"
+#include "../include/Socket.h"
+
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <signal.h>
+#include <sys/wait.h>
+
+namespace
+{
+	const char HELLO_MAGIC[4] = {'G', 'I', 'W', 'K'};
+	const unsigned int PROTOCOL_VERSION = 2;
+}
+
+const int RenderCoordinator::HEARTBEAT_INTERVAL_MS;
+const int RenderCoordinator::WORKER_TIMEOUT_MS;
+
+std::string RenderCoordinator::makeHello(
+	const std::vector<float>& parameters,
+	unsigned long long scene_key,
+	unsigned long long photon_map_key)
+{
+	std::string hello(HELLO_MAGIC, sizeof(HELLO_MAGIC));
+	int n_parameters = parameters.size();
+	hello.append(reinterpret_cast<const char*>(&PROTOCOL_VERSION), sizeof(PROTOCOL_VERSION));
+	hello.append(reinterpret_cast<const char*>(&scene_key), sizeof(scene_key));
+	hello.append(reinterpret_cast<const char*>(&photon_map_key), sizeof(photon_map_key));
+	hello.append(reinterpret_cast<const char*>(&n_parameters), sizeof(n_parameters));
+	hello.append(reinterpret_cast<const char*>(parameters.data()), parameters.size() * sizeof(float));
+	return hello;
+}
+
+RenderCoordinator::RenderCoordinator(
+	CompositeRenderer* composite,
+	int job_samples,
+	unsigned long long scene_key,
+	unsigned long long photon_map_key) :
+	composite_(composite),
+	JOB_SAMPLES_(job_samples > 0 ? job_samples : 1),
+	HELLO_(makeHello(composite->getParameters(), scene_key, photon_map_key)),
+	listening_socket_(-1),
+	next_sample_(composite->getNumberOfSamples()),
+	n_jobs_running_(0),
+	n_workers_connected_(0),
+	budget_reached_(false)
+{}
+
+RenderCoordinator::~RenderCoordinator()
+{
+	std::map<int, Result>::iterator it;
+	for (it = results_.begin(); it != results_.end(); ++it)
+		delete it->second.samples;
+	if (listening_socket_ >= 0)
+		socket_io::closeSocket(listening_socket_);
+}
+
+bool RenderCoordinator::listen(int port)
+{
+	listening_socket_ = socket_io::listenTcp(port);
+	return listening_socket_ >= 0;
+}
+
+int RenderCoordinator::getPort() const
+{
+	return socket_io::getPort(listening_socket_);
+}
+
+bool RenderCoordinator::run(const std::vector<pid_t>& local_workers)
+{
+	std::vector<pid_t> running_workers = local_workers;
+	bool success = true;
+	while (true)
+	{
+		reapProcesses(&running_workers, false);
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (isFinished())
+				break;
+			if (!local_workers.empty() && running_workers.empty() && !n_workers_connected_)
+			{
+				std::cout << "All local workers exited before the render was done" << std::endl;
+				success = false;
+				break;
+			}
+		}
+		// Wakes up now and then to see if the workers are done
+		int socket = socket_io::acceptConnection(listening_socket_, 100);
+		if (socket < 0)
+			continue;
+		int worker = worker_threads_.size();
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			n_workers_connected_++;
+		}
+		worker_threads_.push_back(std::thread([this, socket, worker]()
+		{
+			serveWorker(socket, worker);
+			std::lock_guard<std::mutex> lock(mutex_);
+			n_workers_connected_--;
+		}));
+	}
+	job_finished_.notify_all();
+	for (int i = 0; i < worker_threads_.size(); ++i)
+		worker_threads_[i].join();
+	socket_io::closeSocket(listening_socket_);
+	listening_socket_ = -1;
+	reapProcesses(&running_workers, true);
+	return success;
+}
+
+void RenderCoordinator::reapProcesses(std::vector<pid_t>* processes, bool wait)
+{
+	// Workers exit after the last job, hung ones are killed after the
+	// timeout
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	while (true)
+	{
+		for (int i = 0; i < processes->size(); )
+		{
+			if (waitpid((*processes)[i], NULL, WNOHANG) != 0)
+				processes->erase(processes->begin() + i);
+			else
+				++i;
+		}
+		if (!wait || processes->empty())
+			return;
+		if (std::chrono::steady_clock::now() - start > std::chrono::milliseconds(WORKER_TIMEOUT_MS))
+			break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+	for (int i = 0; i < processes->size(); ++i)
+	{
+		kill((*processes)[i], SIGKILL);
+		waitpid((*processes)[i], NULL, 0);
+	}
+	processes->clear();
+}
+
+int RenderCoordinator::getNumberOfWorkers() const
+{
+	return worker_threads_.size();
+}
+
+void RenderCoordinator::serveWorker(int socket, int worker)
+{
+	// Messages of any other length than the expected ones are refused
+	// before anything is allocated for them
+	std::string hello;
+	Job job = {0, 0};
+	socket_io::setReceiveTimeout(socket, WORKER_TIMEOUT_MS);
+	if (!socket_io::receiveMessage(socket, &hello, HELLO_.size()))
+	{
+		std::cout << "Worker " << worker << " sent an invalid hello, rejected" << std::endl;
+		socket_io::closeSocket(socket);
+		return;
+	}
+	if (hello != HELLO_)
+	{
+		std::cout << "Worker " << worker << " has another scene, photon map, camera or settings, rejected" << std::endl;
+		job.first_sample = -1;
+		socket_io::sendAll(socket, &job, sizeof(job));
+		socket_io::closeSocket(socket);
+		return;
+	}
+	std::cout << "Worker " << worker << " connected" << std::endl;
+
+	const int WIDTH = composite_->getAccumulationBuffer().getWidth();
+	const int HEIGHT = composite_->getAccumulationBuffer().getHeight();
+	const size_t RESULT_SIZE = composite_->getAccumulationBuffer().getWrittenSize();
+	std::string result;
+	while (takeJob(&job))
+	{
+		std::chrono::steady_clock::time_point job_start = std::chrono::steady_clock::now();
+		// Results may have to wait for earlier ones, each gets its own buffer
+		AccumulationBuffer* samples = new AccumulationBuffer(WIDTH, HEIGHT);
+		std::istringstream is;
+		bool received = socket_io::sendAll(socket, &job, sizeof(job));
+		// Empty messages only show the worker is still rendering
+		do
+			received = received && socket_io::receiveMessage(socket, &result, RESULT_SIZE);
+		while (received && result.empty());
+		received = received && result.size() == RESULT_SIZE;
+		if (received)
+		{
+			is.str(result);
+			received = samples->read(is);
+		}
+		if (!received)
+		{
+			std::cout << "Lost worker " << worker << std::endl;
+			delete samples;
+			finishJob(job, NULL, 0, worker);
+			socket_io::closeSocket(socket);
+			return;
+		}
+		double render_time = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - job_start).count();
+		finishJob(job, samples, render_time, worker);
+	}
+	// No more jobs
+	job.first_sample = job.end_sample = 0;
+	socket_io::sendAll(socket, &job, sizeof(job));
+	socket_io::closeSocket(socket);
+}
+
+bool RenderCoordinator::takeJob(Job* job)
+{
+	const int N_SAMPLES = composite_->getTotalNumberOfSamples();
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true)
+	{
+		// Failed jobs are redone even after the budget is reached, the
+		// samples before it must not have gaps
+		if (!failed_jobs_.empty())
+		{
+			*job = failed_jobs_.begin()->second;
+			failed_jobs_.erase(failed_jobs_.begin());
+			n_jobs_running_++;
+			return true;
+		}
+		if (!budget_reached_ && N_SAMPLES &&
+			(next_sample_ < N_SAMPLES || !composite_->hasSampleLimit()))
+		{
+			job->first_sample = next_sample_;
+			job->end_sample = next_sample_ + JOB_SAMPLES_;
+			if (composite_->hasSampleLimit() && job->end_sample > N_SAMPLES)
+				job->end_sample = N_SAMPLES;
+			next_sample_ = job->end_sample;
+			n_jobs_running_++;
+			return true;
+		}
+		// The jobs still running may fail and come back
+		if (!n_jobs_running_)
+			break;
+		job_finished_.wait(lock);
+	}
+	return false;
+}
+
+void RenderCoordinator::finishJob(
+	const Job& job,
+	AccumulationBuffer* samples,
+	double render_time,
+	int worker)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	n_jobs_running_--;
+	if (samples)
+	{
+		Result result = {samples, job.end_sample - job.first_sample, render_time};
+		results_[job.first_sample] = result;
+		std::cout << "Samples " << job.first_sample << " - " << job.end_sample <<
+			" from worker " << worker << std::endl;
+		// In the order of the samples, the same additions as without workers
+		std::map<int, Result>::iterator it;
+		while ((it = results_.find(composite_->getNumberOfSamples())) != results_.end())
+		{
+			composite_->addSamples(*it->second.samples, it->second.n_samples, it->second.render_time);
+			delete it->second.samples;
+			results_.erase(it);
+			std::cout << composite_->getNumberOfSamples() << " samples per pixel done" << std::endl;
+			if (composite_->isBudgetReached())
+				budget_reached_ = true;
+		}
+	}
+	else
+		failed_jobs_[job.first_sample] = job;
+	job_finished_.notify_all();
+}
+
+bool RenderCoordinator::isFinished() const
+{
+	if (n_jobs_running_ || !failed_jobs_.empty())
+		return false;
+	if (budget_reached_ || !composite_->getTotalNumberOfSamples())
+		return true;
+	return composite_->hasSampleLimit() &&
+		next_sample_ >= composite_->getTotalNumberOfSamples();
+}
@@ -0,0 +1,482 @@
+#include "../include/RenderServer.h"
+#include "../include/Camera.h"
+#include "../include/CompositeRenderer.h"
+#include "../include/ImageIO.h"
+#include "../include/Socket.h"
+
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+#include <new>
+#include <unistd.h>
+
+namespace
+{
+	// Same as the normal render
+	const float GAMMA = 1 / 2.2;
+	const int MAX_RESOLUTION = 8192;
+
+	const char* const JOB_STATE_NAMES[] = {
+		"queued", "rendering", "done", "failed", "cancelled",
+	};
+
+	bool parseVector(const std::string& value, glm::vec3* v)
+	{
+		char end;
+		return sscanf(value.c_str(), "%f,%f,%f%c", &v->x, &v->y, &v->z, &end) == 3;
+	}
+}
+
+RenderServer::RenderServer(Scene* scene, const RenderSettings& settings) :
+	scene_(scene),
+	settings_(settings),
+	listening_socket_(-1),
+	next_job_id_(1),
+	shutting_down_(false)
+{}
+
+const int RenderServer::MAX_ENDED_JOBS;
+
+RenderServer::~RenderServer()
+{
+	if (listening_socket_ >= 0)
+	{
+		socket_io::closeSocket(listening_socket_);
+		unlink(socket_path_.c_str());
+	}
+}
+
+bool RenderServer::listen(const char* socket_path)
+{
+	socket_path_ = socket_path;
+	listening_socket_ = socket_io::listenUnix(socket_path_);
+	return listening_socket_ >= 0;
+}
+
+void RenderServer::run()
+{
+	std::thread render_thread(&RenderServer::renderJobs, this);
+	while (true)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (shutting_down_)
+				break;
+		}
+		// Wakes up now and then to see if the server was shut down
+		int socket = socket_io::acceptConnection(listening_socket_, 100);
+		std::lock_guard<std::mutex> lock(mutex_);
+		reapClients();
+		if (socket < 0)
+			continue;
+		clients_.push_back(Client());
+		Client& client = clients_.back();
+		client.socket = socket;
+		client.finished = false;
+		client.thread = std::thread(&RenderServer::serveClient, this, &client);
+	}
+	// Clients waiting for a command see the end of their stream. Only this
+	// thread changes the list.
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::list<Client>::iterator it;
+		for (it = clients_.begin(); it != clients_.end(); ++it)
+		{
+			if (!it->finished)
+				socket_io::shutdownSocket(it->socket);
+		}
+	}
+	std::list<Client>::iterator it;
+	for (it = clients_.begin(); it != clients_.end(); ++it)
+		it->thread.join();
+	clients_.clear();
+	render_thread.join();
+}
+
+void RenderServer::serveClient(Client* client)
+{
+	const int socket = client->socket;
+	std::string line;
+	while (socket_io::receiveLine(socket, &line))
+	{
+		std::istringstream is(line);
+		std::string command;
+		std::string arguments;
+		is >> command;
+		std::getline(is, arguments);
+		std::istringstream argument_stream(arguments);
+		int id = 0;
+		bool has_id = bool(argument_stream >> id);
+
+		std::string reply;
+		if (command == "render")
+		{
+			Job job;
+			std::string error;
+			if (parseJob(arguments, &job, &error))
+			{
+				// Nothing renders jobs queued after a shutdown
+				std::lock_guard<std::mutex> lock(mutex_);
+				if (shutting_down_)
+					reply = "error shutting down";
+				else
+				{
+					job.id = next_job_id_++;
+					if (job.output_file.empty())
+						job.output_file = "job_" + std::to_string(job.id) + ".ppm";
+					jobs_[job.id] = job;
+					queue_.push_back(job.id);
+					jobs_changed_.notify_all();
+					reply = "queued " + std::to_string(job.id);
+				}
+			}
+			else
+				reply = "error " + error;
+		}
+		else if (command == "status")
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			std::map<int, Job>::const_iterator it = jobs_.find(id);
+			if (has_id && it != jobs_.end())
+				reply = describeJob(it->second);
+			else if (has_id)
+				reply = "error no job " + std::to_string(id);
+			else
+			{
+				// Number of jobs, then a line for each
+				reply = "jobs " + std::to_string(jobs_.size());
+				for (it = jobs_.begin(); it != jobs_.end(); ++it)
+					reply += "\n" + describeJob(it->second);
+			}
+		}
+		else if (command == "wait")
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			std::map<int, Job>::iterator it = jobs_.find(id);
+			if (!has_id || it == jobs_.end())
+				reply = "error no job " + std::to_string(id);
+			else
+			{
+				// Every update until the job ends, the last one is the reply.
+				// The job is not pruned while it is waited for. After a
+				// shutdown only a rendering job still changes.
+				it->second.n_waiters++;
+				int n_updates_sent = it->second.n_updates;
+				while (!isFinished(it->second) &&
+					!(shutting_down_ && it->second.state != RENDERING))
+				{
+					jobs_changed_.wait(lock);
+					if (it->second.n_updates == n_updates_sent || isFinished(it->second))
+						continue;
+					n_updates_sent = it->second.n_updates;
+					std::string status = describeJob(it->second);
+					lock.unlock();
+					bool sent = socket_io::sendLine(socket, status);
+					lock.lock();
+					if (!sent)
+						break;
+				}
+				reply = describeJob(it->second);
+				it->second.n_waiters--;
+			}
+		}
+		else if (command == "cancel")
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			std::map<int, Job>::iterator it = jobs_.find(id);
+			if (!has_id || it == jobs_.end())
+				reply = "error no job " + std::to_string(id);
+			else if (isFinished(it->second))
+				reply = "error job " + std::to_string(id) + " has ended";
+			else
+			{
+				Job& job = it->second;
+				job.cancel_requested = true;
+				if (job.state == QUEUED)
+				{
+					queue_.erase(std::find(queue_.begin(), queue_.end(), id));
+					job.state = CANCELLED;
+					job.n_updates++;
+					pruneJobs();
+				}
+				jobs_changed_.notify_all();
+				reply = "cancelled " + std::to_string(id);
+			}
+		}
+		else if (command == "shutdown")
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			shutting_down_ = true;
+			for (int i = 0; i < queue_.size(); ++i)
+			{
+				jobs_[queue_[i]].state = CANCELLED;
+				jobs_[queue_[i]].n_updates++;
+			}
+			queue_.clear();
+			pruneJobs();
+			jobs_changed_.notify_all();
+			reply = "shutting down";
+		}
+		else if (command == "quit")
+			break;
+		else if (!command.empty())
+			reply = "error unknown command " + command;
+		else
+			continue;
+		if (!socket_io::sendLine(socket, reply))
+			break;
+	}
+	std::lock_guard<std::mutex> lock(mutex_);
+	socket_io::closeSocket(socket);
+	client->finished = true;
+}
+
+void RenderServer::renderJobs()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true)
+	{
+		while (queue_.empty() && !shutting_down_)
+			jobs_changed_.wait(lock);
+		if (shutting_down_)
+			break;
+		Job* job = &jobs_[queue_.front()];
+		queue_.pop_front();
+		job->state = RENDERING;
+		job->n_updates++;
+		lock.unlock();
+		jobs_changed_.notify_all();
+		renderJob(job);
+		lock.lock();
+	}
+}
+
+void RenderServer::renderJob(Job* job)
+{
+	// Only the progress of the job changes while it renders
+	Job parameters;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		parameters = *job;
+	}
+	std::cout << "Rendering job " << parameters.id << " to " << parameters.output_file << std::endl;
+
+	// A job of up to MAX_RESOLUTION may not fit in memory, it fails
+	// without taking the server down
+	bool cancelled = false;
+	bool written = false;
+	try
+	{
+		Camera camera(
+			parameters.eye,
+			parameters.center,
+			parameters.up,
+			parameters.fov,
+			parameters.width,
+			parameters.height);
+		RenderSettings settings = settings_;
+		settings.time_limit = parameters.time_limit;
+		settings.target_noise = parameters.target_noise;
+		CompositeRenderer composite(
+			scene_,
+			&camera,
+			settings,
+			parameters.specular_samples,
+			parameters.caustics_samples,
+			parameters.diffuse_samples);
+
+		// The time limit of the job counts from here
+		typedef std::chrono::steady_clock Clock;
+		Clock::time_point start = Clock::now();
+		composite.setStartTime(start);
+		while (true)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				cancelled = job->cancel_requested || shutting_down_;
+			}
+			if (cancelled || !composite.renderPass())
+				break;
+			double render_time = std::chrono::duration<double>(Clock::now() - start).count();
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				job->n_samples_done = composite.getNumberOfSamples();
+				job->n_samples_total = composite.hasSampleLimit() ? composite.getTotalNumberOfSamples() : 0;
+				job->relative_error = composite.getRelativeError();
+				job->render_time = render_time;
+				job->n_updates++;
+			}
+			jobs_changed_.notify_all();
+		}
+
+		written = !cancelled && image_io::saveEstimate(
+			parameters.output_file.c_str(), composite.getAccumulationBuffer(), GAMMA);
+	}
+	catch (const std::bad_alloc&)
+	{
+		std::cout << "Not enough memory for job " << parameters.id << std::endl;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		job->state = cancelled ? CANCELLED : (written ? DONE : FAILED);
+		job->n_updates++;
+		std::cout << "Job " << job->id << " " << JOB_STATE_NAMES[job->state] << std::endl;
+		pruneJobs();
+	}
+	jobs_changed_.notify_all();
+}
+
+bool RenderServer::parseJob(const std::string& arguments, Job* job, std::string* error) const
+{
+	// The camera of the normal render and the samples of the server settings
+	job->id = 0;
+	job->width = settings_.width;
+	job->height = settings_.height;
+	job->eye = glm::vec3(0, 0, 3.2);
+	job->center = glm::vec3(0, 0, 0);
+	job->up = glm::vec3(0, 1, 0);
+	job->fov = M_PI / 3;
+	job->specular_samples = settings_.sub_sampling_direct_specular;
+	job->caustics_samples = settings_.sub_sampling_caustics;
+	job->diffuse_samples = settings_.sub_sampling_monte_carlo;
+	job->time_limit = settings_.time_limit;
+	job->target_noise = settings_.target_noise;
+	job->state = QUEUED;
+	job->cancel_requested = false;
+	job->n_samples_done = 0;
+	job->n_samples_total = 0;
+	job->relative_error = 0;
+	job->render_time = 0;
+	job->n_updates = 0;
+	job->n_waiters = 0;
+
+	std::istringstream is(arguments);
+	std::string argument;
+	while (is >> argument)
+	{
+		size_t equals = argument.find('=');
+		if (equals == std::string::npos)
+		{
+			*error = "expected key=value: " + argument;
+			return false;
+		}
+		std::string key = argument.substr(0, equals);
+		std::string value = argument.substr(equals + 1);
+		bool valid = true;
+		try
+		{
+			if (key == "output")
+				job->output_file = value;
+			else if (key == "width")
+				job->width = std::stoi(value);
+			else if (key == "height")
+				job->height = std::stoi(value);
+			else if (key == "eye")
+				valid = parseVector(value, &job->eye);
+			else if (key == "center")
+				valid = parseVector(value, &job->center);
+			else if (key == "up")
+				valid = parseVector(value, &job->up);
+			else if (key == "fov")
+				job->fov = glm::radians(std::stof(value));
+			else if (key == "spp")
+			{
+				job->specular_samples = job->caustics_samples = job->diffuse_samples =
+					std::stoi(value);
+			}
+			else if (key == "spp-specular")
+				job->specular_samples = std::stoi(value);
+			else if (key == "spp-caustics")
+				job->caustics_samples = std::stoi(value);
+			else if (key == "spp-diffuse")
+				job->diffuse_samples = std::stoi(value);
+			else if (key == "time-limit")
+				job->time_limit = std::stof(value);
+			else if (key == "target-noise")
+				job->target_noise = std::stof(value);
+			else
+			{
+				*error = "unknown key " + key;
+				return false;
+			}
+		}
+		catch (const std::exception& e)
+		{
+			valid = false;
+		}
+		if (!valid)
+		{
+			*error = "invalid value for " + key;
+			return false;
+		}
+	}
+	if (job->width <= 0 || job->height <= 0 ||
+		job->width > MAX_RESOLUTION || job->height > MAX_RESOLUTION)
+	{
+		*error = "invalid resolution";
+		return false;
+	}
+	if (job->specular_samples < 0 || job->caustics_samples < 0 || job->diffuse_samples < 0)
+	{
+		*error = "invalid samples per pixel";
+		return false;
+	}
+	if (!(job->fov > 0 && job->fov < M_PI) || glm::length(job->center - job->eye) == 0)
+	{
+		*error = "invalid camera";
+		return false;
+	}
+	return true;
+}
+
+std::string RenderServer::describeJob(const Job& job) const
+{
+	std::ostringstream os;
+	os << job.id << " " << JOB_STATE_NAMES[job.state] << " " << job.n_samples_done;
+	if (job.n_samples_total)
+		os << "/" << job.n_samples_total;
+	os << " spp, error " << job.relative_error << ", " << job.render_time << " s, " <<
+		job.output_file;
+	return os.str();
+}
+
+bool RenderServer::isFinished(const Job& job)
+{
+	return job.state == DONE || job.state == FAILED || job.state == CANCELLED;
+}
+
+void RenderServer::pruneJobs()
+{
+	// Ids increase, the map is in the order the jobs came
+	int n_ended = 0;
+	std::map<int, Job>::iterator it;
+	for (it = jobs_.begin(); it != jobs_.end(); ++it)
+		n_ended += isFinished(it->second);
+	for (it = jobs_.begin(); it != jobs_.end() && n_ended > MAX_ENDED_JOBS; )
+	{
+		if (isFinished(it->second) && !it->second.n_waiters)
+		{
+			it = jobs_.erase(it);
+			n_ended--;
+		}
+		else
+			++it;
+	}
+}
+
+void RenderServer::reapClients()
+{
+	std::list<Client>::iterator it = clients_.begin();
+	while (it != clients_.end())
+	{
+		if (it->finished)
+		{
+			it->thread.join();
+			it = clients_.erase(it);
+		}
+		else
+			++it;
+	}
+}
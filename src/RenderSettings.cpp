@@ -0,0 +1,274 @@
+#include "../include/RenderSettings.h"
+#include "../include/Sampler.h"
+#include "../include/TileScheduler.h"
+
+#include <iostream>
+#include <string>
+
+RenderSettings::RenderSettings() :
+	scene_file_path(NULL),
+	width(1024),
+	height(768),
+	sub_sampling_caustics(10),
+	sub_sampling_monte_carlo(500),
+	sub_sampling_direct_specular(100),
+	number_of_photons_emission(2000000),
+	sampler_type(Sampler::SOBOL),
+	min_path_depth(3),
+	max_path_depth(20),
+	first_bounce_splits(1),
+	stochastic_fresnel(false),
+	n_threads(0),
+	pin_threads(false),
+	tile_size(16),
+	tile_order(TileScheduler::HILBERT),
+	pass_samples(4),
+	snapshot_interval(0),
+	time_limit(0),
+	target_noise(0),
+	checkpoint_file("checkpoint.bin"),
+	checkpoint_interval(0),
+	resume(false),
+	wavefront(false),
+	wavefront_batch_size(1 << 18),
+	coordinator_port(-1),
+	local_workers(0),
+	worker_address(NULL),
+	server_socket(NULL),
+	sequence_file(NULL),
+	sequence_output("frame_"),
+	photon_map_cache(true),
+	progressive_photon_mapping(false),
+	progressive_passes(100),
+	progressive_photons_per_pass(200000),
+	progressive_initial_radius(0.1),
+	progressive_alpha(0.7),
+	adaptive_sampling(false),
+	adaptive_threshold(0.02),
+	adaptive_min_samples(16),
+	adaptive_max_samples(2000)
+{}
+
+static void printUsage(const char* program_name)
+{
+	std::cout << "Usage: " << program_name << " scene_file.xml [options]" << std::endl;
+	std::cout << "Options:" << std::endl;
+	std::cout << "  --no-photon-cache      Always build the photon map, do not save it" << std::endl;
+	std::cout << "  --sampler type         independent, stratified, halton or sobol (default)" << std::endl;
+	std::cout << "  --spp-specular n       Samples per pixel for lamps seen through mirrors and glass" << std::endl;
+	std::cout << "  --spp-caustics n       Samples per pixel for caustic photons" << std::endl;
+	std::cout << "  --spp-diffuse n        Samples per pixel for Monte Carlo diffuse light" << std::endl;
+	std::cout << "  --min-depth n          Bounces before Russian roulette starts" << std::endl;
+	std::cout << "  --max-depth n          Maximum number of bounces of camera paths" << std::endl;
+	std::cout << "  --split n              Samples at the first diffuse bounce of each path" << std::endl;
+	std::cout << "  --fresnel-sampling     Pick reflection or refraction at glass by the Fresnel term" << std::endl;
+	std::cout << "  --threads n            Number of threads (default OMP_NUM_THREADS or all)" << std::endl;
+	std::cout << "  --pin-threads          Pin each thread to its own CPU" << std::endl;
+	std::cout << "  --tile-size n          Side of the square tiles in pixels" << std::endl;
+	std::cout << "  --tile-order order     scanline, hilbert (default) or spiral" << std::endl;
+	std::cout << "  --pass-spp n           Samples per pixel of each progressive pass" << std::endl;
+	std::cout << "  --snapshot-interval s  Write snapshot.ppm every s seconds (also on SIGUSR1)" << std::endl;
+	std::cout << "  --time-limit s         Add passes until s seconds have passed since the start" << std::endl;
+	std::cout << "  --target-noise e       Add passes until the estimated relative error is below e" << std::endl;
+	std::cout << "  --checkpoint file      Checkpoint file (default checkpoint.bin)" << std::endl;
+	std::cout << "  --checkpoint-interval s  Save a checkpoint every s seconds and on SIGTERM / SIGINT" << std::endl;
+	std::cout << "  --resume               Continue from the checkpoint file" << std::endl;
+	std::cout << "  --wavefront            Trace the paths in batches, one stage at a time" << std::endl;
+	std::cout << "  --wavefront-batch n    Camera paths per wavefront batch" << std::endl;
+	std::cout << "  --coordinator port     Hand out the composite samples to workers on port" << std::endl;
+	std::cout << "  --local-workers n      Start n worker processes on this machine" << std::endl;
+	std::cout << "  --worker host:port     Render samples for the coordinator at host:port" << std::endl;
+	std::cout << "  --server socket        Keep the scene loaded and render jobs sent to socket" << std::endl;
+	std::cout << "  --sequence file        Render the frames of the camera keyframes in file" << std::endl;
+	std::cout << "  --sequence-output p    Frames are written to p0000.ppm, ... (default frame_)" << std::endl;
+	std::cout << "  --sppm                 Stochastic progressive photon mapping" << std::endl;
+	std::cout << "  --sppm-passes n        Number of photon passes" << std::endl;
+	std::cout << "  --sppm-photons n       Photons emitted per pass" << std::endl;
+	std::cout << "  --sppm-radius r        Initial gather radius" << std::endl;
+	std::cout << "  --sppm-alpha a         Fraction of photons kept per pass (0, 1]" << std::endl;
+	std::cout << "  --adaptive t           Adaptive Monte Carlo sampling to relative error t" << std::endl;
+	std::cout << "  --adaptive-min n       Samples per pixel in the first round" << std::endl;
+	std::cout << "  --adaptive-max n       Maximum samples per pixel" << std::endl;
+}
+
+bool parseRenderSettings(int argc, char const *argv[], RenderSettings* settings)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string argument = argv[i];
+		// All options except the flags take one value
+		bool has_value = i + 1 < argc;
+		try
+		{
+			if (argument == "--no-photon-cache")
+				settings->photon_map_cache = false;
+			else if (argument == "--sampler" && has_value)
+			{
+				std::string type = argv[++i];
+				settings->sampler_type = -1;
+				for (int t = 0; t < Sampler::N_TYPES; ++t)
+				{
+					if (type == Sampler::getTypeName(t))
+						settings->sampler_type = t;
+				}
+				if (settings->sampler_type < 0)
+				{
+					std::cout << "Unknown sampler: " << type << std::endl;
+					printUsage(argv[0]);
+					return false;
+				}
+			}
+			else if (argument == "--spp-specular" && has_value)
+				settings->sub_sampling_direct_specular = std::stoi(argv[++i]);
+			else if (argument == "--spp-caustics" && has_value)
+				settings->sub_sampling_caustics = std::stoi(argv[++i]);
+			else if (argument == "--spp-diffuse" && has_value)
+				settings->sub_sampling_monte_carlo = std::stoi(argv[++i]);
+			else if (argument == "--min-depth" && has_value)
+				settings->min_path_depth = std::stoi(argv[++i]);
+			else if (argument == "--max-depth" && has_value)
+				settings->max_path_depth = std::stoi(argv[++i]);
+			else if (argument == "--split" && has_value)
+				settings->first_bounce_splits = std::stoi(argv[++i]);
+			else if (argument == "--fresnel-sampling")
+				settings->stochastic_fresnel = true;
+			else if (argument == "--threads" && has_value)
+				settings->n_threads = std::stoi(argv[++i]);
+			else if (argument == "--pin-threads")
+				settings->pin_threads = true;
+			else if (argument == "--tile-size" && has_value)
+				settings->tile_size = std::stoi(argv[++i]);
+			else if (argument == "--tile-order" && has_value)
+			{
+				std::string order = argv[++i];
+				settings->tile_order = -1;
+				for (int o = 0; o < TileScheduler::N_ORDERS; ++o)
+				{
+					if (order == TileScheduler::getOrderName(o))
+						settings->tile_order = o;
+				}
+				if (settings->tile_order < 0)
+				{
+					std::cout << "Unknown tile order: " << order << std::endl;
+					printUsage(argv[0]);
+					return false;
+				}
+			}
+			else if (argument == "--pass-spp" && has_value)
+				settings->pass_samples = std::stoi(argv[++i]);
+			else if (argument == "--snapshot-interval" && has_value)
+				settings->snapshot_interval = std::stof(argv[++i]);
+			else if (argument == "--time-limit" && has_value)
+				settings->time_limit = std::stof(argv[++i]);
+			else if (argument == "--target-noise" && has_value)
+				settings->target_noise = std::stof(argv[++i]);
+			else if (argument == "--checkpoint" && has_value)
+				settings->checkpoint_file = argv[++i];
+			else if (argument == "--checkpoint-interval" && has_value)
+				settings->checkpoint_interval = std::stof(argv[++i]);
+			else if (argument == "--resume")
+				settings->resume = true;
+			else if (argument == "--wavefront")
+				settings->wavefront = true;
+			else if (argument == "--wavefront-batch" && has_value)
+				settings->wavefront_batch_size = std::stoi(argv[++i]);
+			else if (argument == "--coordinator" && has_value)
+				settings->coordinator_port = std::stoi(argv[++i]);
+			else if (argument == "--local-workers" && has_value)
+				settings->local_workers = std::stoi(argv[++i]);
+			else if (argument == "--worker" && has_value)
+				settings->worker_address = argv[++i];
+			else if (argument == "--server" && has_value)
+				settings->server_socket = argv[++i];
+			else if (argument == "--sequence" && has_value)
+				settings->sequence_file = argv[++i];
+			else if (argument == "--sequence-output" && has_value)
+				settings->sequence_output = argv[++i];
+			else if (argument == "--sppm")
+				settings->progressive_photon_mapping = true;
+			else if (argument == "--sppm-passes" && has_value)
+				settings->progressive_passes = std::stoi(argv[++i]);
+			else if (argument == "--sppm-photons" && has_value)
+				settings->progressive_photons_per_pass = std::stoi(argv[++i]);
+			else if (argument == "--sppm-radius" && has_value)
+				settings->progressive_initial_radius = std::stof(argv[++i]);
+			else if (argument == "--sppm-alpha" && has_value)
+				settings->progressive_alpha = std::stof(argv[++i]);
+			else if (argument == "--adaptive" && has_value)
+			{
+				settings->adaptive_sampling = true;
+				settings->adaptive_threshold = std::stof(argv[++i]);
+			}
+			else if (argument == "--adaptive-min" && has_value)
+				settings->adaptive_min_samples = std::stoi(argv[++i]);
+			else if (argument == "--adaptive-max" && has_value)
+				settings->adaptive_max_samples = std::stoi(argv[++i]);
+			else if (argument.compare(0, 2, "--") != 0 && !settings->scene_file_path)
+				settings->scene_file_path = argv[i];
+			else
+			{
+				std::cout << "Invalid argument: " << argument << std::endl;
+				printUsage(argv[0]);
+				return false;
+			}
+		}
+		catch (const std::exception& e)
+		{
+			std::cout << "Invalid value for " << argument << std::endl;
+			printUsage(argv[0]);
+			return false;
+		}
+	}
+	if (!settings->scene_file_path)
+	{
+		printUsage(argv[0]);
+		return false;
+	}
+	// Outside of it the gather radius grows or collapses to zero
+	if (!(settings->progressive_alpha > 0 && settings->progressive_alpha <= 1))
+	{
+		std::cout << "--sppm-alpha must be in (0, 1]" << std::endl;
+		printUsage(argv[0]);
+		return false;
+	}
+	// A zero radius divides the density estimate by zero, no passes or
+	// photons leave the progressive render empty
+	if (!(settings->progressive_initial_radius > 0))
+	{
+		std::cout << "--sppm-radius must be positive" << std::endl;
+		printUsage(argv[0]);
+		return false;
+	}
+	if (settings->progressive_passes <= 0 || settings->progressive_photons_per_pass <= 0)
+	{
+		std::cout << "--sppm-passes and --sppm-photons must be positive" << std::endl;
+		printUsage(argv[0]);
+		return false;
+	}
+	// Local workers need a coordinator, any port will do
+	if (settings->local_workers > 0 && settings->coordinator_port < 0)
+		settings->coordinator_port = 0;
+	if (settings->coordinator_port >= 0 &&
+		(settings->checkpoint_interval > 0 || settings->resume))
+	{
+		std::cout << "Checkpoints can not be used with --coordinator" << std::endl;
+		return false;
+	}
+	if (settings->server_socket && (settings->progressive_photon_mapping ||
+		settings->adaptive_sampling || settings->coordinator_port >= 0 ||
+		settings->worker_address || settings->resume))
+	{
+		std::cout << "--server only renders the composite pass, without --sppm, --adaptive, "
+			"--coordinator, --worker or --resume" << std::endl;
+		return false;
+	}
+	if (settings->sequence_file && (settings->progressive_photon_mapping ||
+		settings->adaptive_sampling || settings->coordinator_port >= 0 ||
+		settings->worker_address || settings->server_socket || settings->resume))
+	{
+		std::cout << "--sequence only renders the composite pass, without --sppm, --adaptive, "
+			"--coordinator, --worker, --server or --resume" << std::endl;
+		return false;
+	}
+	return true;
+}
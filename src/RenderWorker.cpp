@@ -0,0 +1,98 @@
+#include "../include/RenderWorker.h"
+#include "../include/RenderCoordinator.h"
+#include "../include/Socket.h"
+
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+RenderWorker::RenderWorker(
+	CompositeRenderer* composite,
+	unsigned long long scene_key,
+	unsigned long long photon_map_key) :
+	composite_(composite),
+	HELLO_(RenderCoordinator::makeHello(composite->getParameters(), scene_key, photon_map_key)),
+	n_jobs_(0)
+{}
+
+bool RenderWorker::run(const std::string& coordinator_address)
+{
+	std::string host;
+	int port;
+	if (!socket_io::parseAddress(coordinator_address, &host, &port))
+	{
+		std::cout << "Invalid coordinator address: " << coordinator_address << std::endl;
+		return false;
+	}
+	int socket = socket_io::connectTcp(host, port);
+	if (socket < 0)
+		return false;
+	if (!socket_io::sendMessage(socket, HELLO_))
+	{
+		std::cout << "Lost the coordinator" << std::endl;
+		socket_io::closeSocket(socket);
+		return false;
+	}
+
+	bool success = true;
+	RenderCoordinator::Job job;
+	while (true)
+	{
+		if (!socket_io::receiveAll(socket, &job, sizeof(job)))
+		{
+			std::cout << "Lost the coordinator" << std::endl;
+			success = false;
+			break;
+		}
+		if (job.first_sample < 0)
+		{
+			std::cout << "The coordinator has another scene, photon map, camera or settings" << std::endl;
+			success = false;
+			break;
+		}
+		if (job.end_sample <= job.first_sample)
+			break;
+
+		std::cout << "Rendering samples " << job.first_sample << " - " << job.end_sample << std::endl;
+		// Only the samples of this job are sent back. Empty messages tell
+		// the coordinator that the worker is still rendering.
+		std::mutex heartbeat_mutex;
+		std::condition_variable job_rendered;
+		bool rendered = false;
+		std::thread heartbeat([&]()
+		{
+			std::unique_lock<std::mutex> lock(heartbeat_mutex);
+			while (!job_rendered.wait_for(lock,
+				std::chrono::milliseconds(RenderCoordinator::HEARTBEAT_INTERVAL_MS),
+				[&]() { return rendered; }))
+				socket_io::sendMessage(socket, std::string());
+		});
+		composite_->clear();
+		composite_->renderSamples(job.first_sample, job.end_sample);
+		{
+			std::lock_guard<std::mutex> lock(heartbeat_mutex);
+			rendered = true;
+		}
+		job_rendered.notify_one();
+		heartbeat.join();
+		std::ostringstream os;
+		composite_->getAccumulationBuffer().write(os);
+		if (!socket_io::sendMessage(socket, os.str()))
+		{
+			std::cout << "Lost the coordinator" << std::endl;
+			success = false;
+			break;
+		}
+		n_jobs_++;
+	}
+	socket_io::closeSocket(socket);
+	return success;
+}
+
+int RenderWorker::getNumberOfJobs() const
+{
+	return n_jobs_;
+}
@@ -0,0 +1,311 @@
+#include "../include/Sampler.h"
+
+namespace
+{
+	// pcg4d by Jarzynski and Olano, "Hash Functions for GPU Rendering" (2020)
+	unsigned int pcg4d(
+		unsigned int x,
+		unsigned int y,
+		unsigned int z,
+		unsigned int w)
+	{
+		x = x * 1664525u + 1013904223u;
+		y = y * 1664525u + 1013904223u;
+		z = z * 1664525u + 1013904223u;
+		w = w * 1664525u + 1013904223u;
+
+		x += y * w; y += z * x; z += x * y; w += y * z;
+		x ^= x >> 16; y ^= y >> 16; z ^= z >> 16; w ^= w >> 16;
+		x += y * w; y += z * x; z += x * y; w += y * z;
+		return x;
+	}
+
+	// Pseudo random permutation of i in [0, l) from Kensler,
+	// "Correlated Multi-Jittered Sampling" (2013)
+	unsigned int permute(unsigned int i, unsigned int l, unsigned int p)
+	{
+		unsigned int w = l - 1;
+		w |= w >> 1;
+		w |= w >> 2;
+		w |= w >> 4;
+		w |= w >> 8;
+		w |= w >> 16;
+		do
+		{
+			i ^= p; i *= 0xe170893d;
+			i ^= p >> 16;
+			i ^= (i & w) >> 4;
+			i ^= p >> 8; i *= 0x0929eb3f;
+			i ^= p >> 23;
+			i ^= (i & w) >> 1; i *= 1 | p >> 27;
+			i *= 0x6935fa69;
+			i ^= (i & w) >> 11; i *= 0x74dcb303;
+			i ^= (i & w) >> 2; i *= 0x9e501cc3;
+			i ^= (i & w) >> 2; i *= 0xc860a3df;
+			i &= w;
+			i ^= i >> 5;
+		} while (i >= l);
+		return (i + p) % l;
+	}
+
+	unsigned int reverseBits(unsigned int x)
+	{
+		x = (x << 16) | (x >> 16);
+		x = ((x & 0x00ff00ff) << 8) | ((x & 0xff00ff00) >> 8);
+		x = ((x & 0x0f0f0f0f) << 4) | ((x & 0xf0f0f0f0) >> 4);
+		x = ((x & 0x33333333) << 2) | ((x & 0xcccccccc) >> 2);
+		x = ((x & 0x55555555) << 1) | ((x & 0xaaaaaaaa) >> 1);
+		return x;
+	}
+
+	float toFloat(unsigned int x)
+	{
+		// The 24 highest bits fit exactly in a float
+		return (x >> 8) * (1.0f / 16777216.0f);
+	}
+
+	// (i + jitter) / n without rounding up to one
+	float stratum(unsigned int i, float jitter, unsigned int n)
+	{
+		float u = (i + double(jitter)) / n;
+		return glm::min(u, 0.99999994f); // Largest float below one
+	}
+
+	const int N_PRIMES = 64;
+	const unsigned int PRIMES[N_PRIMES] = {
+		2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+		59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131,
+		137, 139, 149, 151, 157, 163, 167, 173, 179, 181, 191, 193, 197, 199, 211, 223,
+		227, 229, 233, 239, 241, 251, 257, 263, 269, 271, 277, 281, 283, 293, 307, 311};
+
+	// Owen scrambled radical inverse: every digit, including the leading
+	// zeros, goes through a random permutation of the base that depends on
+	// the digits before it. With only a rotation the first few samples of a
+	// large prime base all fall in a small interval.
+	float scrambledRadicalInverse(unsigned int i, unsigned int base, unsigned int scramble)
+	{
+		double inverse_base = 1.0 / base;
+		double factor = inverse_base;
+		double value = 0;
+		unsigned int prefix = 0;
+		for (unsigned int digit = 0; factor > 1e-8; ++digit)
+		{
+			unsigned int d = i % base;
+			value += permute(d, base, pcg4d(scramble, digit, prefix, 0)) * factor;
+			prefix = prefix * base + d;
+			i /= base;
+			factor *= inverse_base;
+		}
+		return value;
+	}
+
+	// Sobol generator matrices of the first two dimensions, as direction
+	// numbers. The first is the van der Corput sequence.
+	unsigned int sobol(unsigned int index, int dimension)
+	{
+		if (dimension == 0)
+			return reverseBits(index);
+		unsigned int x = 0;
+		unsigned int v = 1u << 31;
+		for (; index; index >>= 1, v ^= v >> 1)
+		{
+			if (index & 1)
+				x ^= v;
+		}
+		return x;
+	}
+
+	unsigned int laineKarrasPermutation(unsigned int x, unsigned int seed)
+	{
+		x += seed;
+		x ^= x * 0x6c50b47cu;
+		x ^= x * 0xb82f1e52u;
+		x ^= x * 0xc7afe638u;
+		x ^= x * 0x8d22f6e6u;
+		return x;
+	}
+
+	unsigned int nestedUniformScramble(unsigned int x, unsigned int seed)
+	{
+		x = reverseBits(x);
+		x = laineKarrasPermutation(x, seed);
+		x = reverseBits(x);
+		return x;
+	}
+}
+
+// --- Sampler class functions --- //
+
+Sampler::Sampler(unsigned int seed) :
+	seed_(seed),
+	pixel_(0),
+	sample_(0),
+	n_samples_(0),
+	dimension_(0)
+{}
+
+Sampler* Sampler::create(int type, unsigned int seed)
+{
+	switch (type)
+	{
+		case STRATIFIED :
+			return new StratifiedSampler(seed);
+		case HALTON :
+			return new HaltonSampler(seed);
+		case SOBOL :
+			return new SobolSampler(seed);
+		default :
+			return new IndependentSampler(seed);
+	}
+}
+
+const char* Sampler::getTypeName(int type)
+{
+	switch (type)
+	{
+		case STRATIFIED :
+			return "stratified";
+		case HALTON :
+			return "halton";
+		case SOBOL :
+			return "sobol";
+		default :
+			return "independent";
+	}
+}
+
+void Sampler::startSample(
+	unsigned int pixel,
+	unsigned int sample,
+	unsigned int n_samples)
+{
+	pixel_ = pixel;
+	sample_ = sample;
+	n_samples_ = n_samples;
+	dimension_ = 0;
+}
+
+unsigned int Sampler::getDimension() const
+{
+	return dimension_;
+}
+
+void Sampler::setDimension(unsigned int dimension)
+{
+	dimension_ = dimension;
+}
+
+unsigned long long Sampler::getStreamPosition() const
+{
+	return ((unsigned long long)sample_ << 16) | dimension_;
+}
+
+unsigned int Sampler::hash(unsigned int dimension) const
+{
+	return pcg4d(pixel_, sample_, dimension, seed_);
+}
+
+unsigned int Sampler::pixelHash(unsigned int dimension) const
+{
+	return pcg4d(pixel_, dimension, seed_, 0x5bd1e995);
+}
+
+// --- IndependentSampler class functions --- //
+
+IndependentSampler::IndependentSampler(unsigned int seed) :
+	Sampler(seed)
+{}
+
+float IndependentSampler::next1D()
+{
+	return toFloat(hash(dimension_++));
+}
+
+glm::vec2 IndependentSampler::next2D()
+{
+	float u = next1D();
+	float v = next1D();
+	return glm::vec2(u, v);
+}
+
+// --- StratifiedSampler class functions --- //
+
+StratifiedSampler::StratifiedSampler(unsigned int seed) :
+	Sampler(seed)
+{}
+
+float StratifiedSampler::next1D()
+{
+	if (n_samples_ > 1 && sample_ < n_samples_)
+	{
+		unsigned int i = permute(sample_, n_samples_, pixelHash(dimension_));
+		return stratum(i, toFloat(hash(dimension_++)), n_samples_);
+	}
+	return toFloat(hash(dimension_++));
+}
+
+glm::vec2 StratifiedSampler::next2D()
+{
+	if (n_samples_ > 1 && sample_ < n_samples_)
+	{
+		// The same pixel hash for all samples gives the permutation and the
+		// scrambling of this pair of dimensions
+		unsigned int pair_hash = pixelHash(dimension_);
+		unsigned int i = permute(sample_, n_samples_, pair_hash);
+		float jitter = toFloat(hash(dimension_));
+		dimension_ += 2;
+		return glm::vec2(
+			stratum(i, jitter, n_samples_),
+			toFloat(reverseBits(i) ^ (pair_hash * 0x9e3779b9)));
+	}
+	float u = toFloat(hash(dimension_++));
+	float v = toFloat(hash(dimension_++));
+	return glm::vec2(u, v);
+}
+
+// --- HaltonSampler class functions --- //
+
+HaltonSampler::HaltonSampler(unsigned int seed) :
+	Sampler(seed)
+{}
+
+float HaltonSampler::next1D()
+{
+	unsigned int dimension = dimension_++;
+	if (dimension >= N_PRIMES)
+		return toFloat(hash(dimension));
+	float u = scrambledRadicalInverse(sample_, PRIMES[dimension], pixelHash(dimension));
+	return glm::min(u, 0.99999994f);
+}
+
+glm::vec2 HaltonSampler::next2D()
+{
+	float u = next1D();
+	float v = next1D();
+	return glm::vec2(u, v);
+}
+
+// --- SobolSampler class functions --- //
+
+SobolSampler::SobolSampler(unsigned int seed) :
+	Sampler(seed)
+{}
+
+float SobolSampler::next1D()
+{
+	unsigned int dimension_hash = pixelHash(dimension_++);
+	unsigned int index = nestedUniformScramble(sample_, dimension_hash);
+	return toFloat(nestedUniformScramble(reverseBits(index), dimension_hash * 0x9e3779b9));
+}
+
+glm::vec2 SobolSampler::next2D()
+{
+	// Each pair of dimensions is the first two Sobol dimensions with its own
+	// shuffling of the sample index, which decorrelates the pairs
+	unsigned int pair_hash = pixelHash(dimension_);
+	dimension_ += 2;
+	unsigned int index = nestedUniformScramble(sample_, pair_hash);
+	unsigned int x = nestedUniformScramble(sobol(index, 0), pcg4d(pair_hash, 0, 0, 0));
+	unsigned int y = nestedUniformScramble(sobol(index, 1), pcg4d(pair_hash, 1, 0, 0));
+	return glm::vec2(toFloat(x), toFloat(y));
+}
@@ -2,24 +2,86 @@
 
 #include "../external_libraries/common_include/pugixml.h"
 #include "../include/xmlTraverser.h"
+#include "../include/Warp.h"
+#include "../include/ThreadPool.h"
 
 #include <iostream>
+#include <fstream>
 #include <string>
-#include <random>
+#include <algorithm>
+#include <cstdio>
+#include <unistd.h>
+
+namespace
+{
+	// A branch of a camera path still to be traced. The radiance of its ray
+	// is the throughput from the camera, including brdfs, material weights
+	// and survival probabilities, so it needs nothing from its parent.
+	struct Branch
+	{
+		Ray ray;
+		int render_mode;
+		int iteration;
+	};
+
+	// Fixed size stack of the branches of one camera path, used instead of
+	// the call stack by Scene::tracePath()
+	class BranchStack
+	{
+	public:
+		BranchStack() : size_(0) {};
+		bool empty() const { return !size_; };
+		// When the stack is full the new branch and the top of the stack
+		// compete, the one that is kept carries both their weights. This
+		// keeps the estimate unbiased for any path depth.
+		void push(const Ray& r, int render_mode, int iteration, Sampler* sampler)
+		{
+			bool full = size_ == CAPACITY;
+			Branch& top = full ? branches_[CAPACITY - 1] : branches_[size_++];
+			if (!full || sampler->next1D() < 0.5)
+			{
+				top.ray = r;
+				top.render_mode = render_mode;
+				top.iteration = iteration;
+			}
+			if (full)
+				top.ray.radiance *= 2;
+		}
+		Branch& pop() { return branches_[--size_]; };
+	private:
+		static const int CAPACITY = 16;
+		Branch branches_[CAPACITY];
+		int size_;
+	};
+}
 
 // --- Scene class functions --- //
 
-Scene::Scene (const char* file_path)
+Scene::Scene (const char* file_path) :
+	file_path_(file_path ? file_path : ""),
+	min_path_depth_(3),
+	max_path_depth_(20),
+	first_bounce_splits_(1),
+	diffuse_render_mode_(MONTE_CARLO),
+	stochastic_fresnel_(false),
+	N_RAY_COUNTERS_(ThreadPool::instance().getNumberOfThreads()),
+	ray_counters_(NULL)
 {
+	void* ray_counters = NULL;
+	if (posix_memalign(&ray_counters, alignof(RayCounters), N_RAY_COUNTERS_ * sizeof(RayCounters)))
+	{
+		std::cout << "Could not allocate the ray counters" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	ray_counters_ = static_cast<RayCounters*>(ray_counters);
+	resetRayStatistics();
+
 	if (!file_path)
 	{
 		std::cout << "No scene file specified. Please use a scene xml file as argument" << std::endl;
 		exit (EXIT_FAILURE);
 	}
 
-	gen_ = new std::mt19937(rd_());
-	dis_ = new std::uniform_real_distribution<float>(0, 1);
-
     pugi::xml_document doc;
     std::cout << "Loading XML file." << std::endl;
     pugi::xml_parse_result result = doc.load_file(file_path);
@@ -33,14 +95,17 @@ Scene::Scene (const char* file_path)
 
 	std::cout << "Creating scene from XML file." << std::endl;
 	doc.traverse(walker);
+
+	std::vector<float> lamp_flux(lamps_.size());
+	for (int i = 0; i < lamps_.size(); ++i)
+		lamp_flux[i] = lamps_[i]->radiosity.norm() * lamps_[i]->getArea();
+	lamp_selection_.build(lamp_flux);
     std::cout << "Scene created!" << std::endl;
 }
 
 Scene::~Scene()
 {
-	delete gen_;
-	delete dis_;
-
+	free(ray_counters_);
 	for (int i = 0; i < objects_.size(); ++i)
 	{
 		delete objects_[i];
@@ -91,6 +156,7 @@ bool Scene::intersectLamp(LightSourceIntersectionData* light_id, Ray r)
 		if (lamps_[i]->intersect(&id_local,r) && id_local.t < lamp_id_smallest_t.t)
 		{
 			lamp_id_smallest_t = id_local;
+			lamp_id_smallest_t.selection_probability = lamp_selection_.probability(i);
 			intersecting_lamp = lamps_[i];
 		}
 	}
@@ -125,77 +191,101 @@ bool Scene::intersectLamp(LightSourceIntersectionData* light_id, Ray r)
 SpectralDistribution Scene::traceDiffuseRay(
 	Ray r,
 	int render_mode,
+	Sampler* sampler,
 	IntersectionData id,
 	int iteration)
 {
 	r.has_intersected = true;
-	// Start by adding the local illumination part (shadow rays)
-	SpectralDistribution total_diffuse = traceLocalDiffuseRay(r, render_mode, id);
-	//if (!(iteration >= 2)) // Do not end here
+	// The first diffuse vertex of a camera path is split in to several
+	// samples, which share the camera ray and any specular bounces before it.
+	// Each of them carries its share of the path throughput.
+	int n_splits = r.has_bounced_diffusely ? 1 : first_bounce_splits_;
+	r.radiance /= n_splits;
+	SpectralDistribution total_diffuse;
+	for (int i = 0; i < n_splits; ++i)
+	{
+		// Start by adding the local illumination part (shadow rays)
+		total_diffuse += traceLocalDiffuseRay(r, render_mode, sampler, id);
 		// Add the indirect illumination part (Monte Carlo sampling)
-		total_diffuse = total_diffuse + traceIndirectDiffuseRay(r, render_mode, id, iteration);
-	return total_diffuse;
+		total_diffuse += traceIndirectDiffuseRay(r, render_mode, sampler, id, iteration);
+	}
+	return total_diffuse / n_splits;
 }
 
 SpectralDistribution Scene::traceLocalDiffuseRay(
 	Ray r,
 	int render_mode,
+	Sampler* sampler,
 	IntersectionData id)
 {
-	SpectralDistribution L_local;
-	// Cast shadow rays
-	// We divide up the area light source in to n_samples area parts.
-	// Used to define the solid angle
-	static const int n_samples = 1;
-	for (int i = 0; i < lamps_.size(); ++i)
-	{
-		for (int j = 0; j < n_samples; ++j)
-		{
-			Ray shadow_ray = r;
-			glm::vec3 differance = lamps_[i]->getPointOnSurface((*dis_)(*gen_),(*dis_)(*gen_)) - shadow_ray.origin;
-			shadow_ray.direction = glm::normalize(differance);
+	if (!lamps_.size())
+		return SpectralDistribution();
+	// Cast one shadow ray
+	ShadowRay shadow_ray;
+	LightSourceIntersectionData shadow_ray_id;
+	getRayCounters().rays++;
+	if (sampleShadowRay(r, id, sampler, &shadow_ray) &&
+		intersectLamp(&shadow_ray_id, shadow_ray.ray))
+		return evaluateShadowRay(-r.direction, id, shadow_ray, shadow_ray_id);
+	return SpectralDistribution();
+}
 
-			SpectralDistribution brdf;// = id.material.color_diffuse / (2 * M_PI); // Dependent on inclination and azimuth
-			float cos_theta = glm::dot(shadow_ray.direction, id.normal);
+bool Scene::sampleShadowRay(
+	const Ray& r,
+	const IntersectionData& id,
+	Sampler* sampler,
+	ShadowRay* shadow_ray)
+{
+	// One lamp is picked per sample, bigger flux => Bigger chance to be
+	// picked. Dividing with the probability keeps the sum over all lamps.
+	int i = lamp_selection_.sample(sampler->next1D());
+	shadow_ray->lamp_probability = lamp_selection_.probability(i);
 
-			LightSourceIntersectionData shadow_ray_id;
+	shadow_ray->ray = r;
+	glm::vec2 lamp_sample = sampler->next2D();
+	glm::vec3 differance = lamps_[i]->getPointOnSurface(lamp_sample.x, lamp_sample.y) - r.origin;
+	shadow_ray->ray.direction = glm::normalize(differance);
+	shadow_ray->distance_squared = glm::dot(differance, differance);
+	shadow_ray->cos_theta = glm::dot(shadow_ray->ray.direction, id.normal);
+	return shadow_ray->cos_theta > 0;
+}
 
-			if (id.material.diffuse_roughness)
-			{
-				brdf = evaluateOrenNayarBRDF(
-					-r.direction,
-					shadow_ray.direction,
-					id.normal,
-					id.material.color_diffuse * id.material.reflectance * (1 -id.material.specular_reflectance),
-					id.material.diffuse_roughness);
-			}
-			else
-				brdf = evaluateLambertianBRDF(
-					-r.direction,
-					shadow_ray.direction,
-					id.normal,
-					id.material.color_diffuse * id.material.reflectance * (1 - id.material.specular_reflectance));
+SpectralDistribution Scene::evaluateShadowRay(
+	glm::vec3 direction_out,
+	const IntersectionData& id,
+	const ShadowRay& shadow_ray,
+	const LightSourceIntersectionData& lamp_id) const
+{
+	SpectralDistribution brdf = evaluateDiffuseBRDF(
+		direction_out,
+		shadow_ray.ray.direction,
+		id.normal,
+		id.material);
+	float cos_light_angle = glm::dot(lamp_id.normal, -shadow_ray.ray.direction);
+	float light_solid_angle = lamp_id.area * glm::clamp(cos_light_angle, 0.0f, 1.0f) /
+		shadow_ray.distance_squared / (M_PI * 2);
 
-			if(intersectLamp(&shadow_ray_id, shadow_ray))
-			{
-				float cos_light_angle = glm::dot(shadow_ray_id.normal, -shadow_ray.direction);
-				float light_solid_angle = shadow_ray_id.area / n_samples * glm::clamp(cos_light_angle, 0.0f, 1.0f) / glm::pow(glm::length(differance), 2) / (M_PI * 2);
-
-				L_local +=
-					brdf *
-					shadow_ray_id.radiosity *
-					cos_theta *
-					light_solid_angle
-					;
-			}
-		}
-	}
-	return L_local;
+	// The lamp can also be found by the indirect ray, which samples
+	// the cosine of the surface. Both estimates are weighted by
+	// multiple importance sampling and summed.
+	float light_pdf = shadow_ray.lamp_probability * shadow_ray.distance_squared /
+		(lamp_id.area * glm::max(cos_light_angle, 1e-6f));
+	float mis_weight = powerHeuristic(light_pdf, shadow_ray.cos_theta / M_PI);
+
+	return
+		brdf *
+		lamp_id.radiosity *
+		shadow_ray.cos_theta *
+		light_solid_angle /
+		shadow_ray.lamp_probability *
+		mis_weight
+		;
 }
 
 SpectralDistribution Scene::traceIndirectDiffuseRay(
 	Ray r,
 	int render_mode,
+	Sampler* sampler,
 	IntersectionData id,
 	int iteration)
 {
@@ -203,28 +293,7 @@ SpectralDistribution Scene::traceIndirectDiffuseRay(
 	static const int n_samples = 1;
 	for (int i = 0; i < n_samples; ++i)
 	{
-		// helper is just a random vector and can not possibly be
-		// a zero vector since id.normal is normalized
-		glm::vec3 helper = id.normal + glm::vec3(1,1,1);
-		glm::vec3 tangent = glm::normalize(glm::cross(id.normal, helper));
-
-		// rand1 is a random number from the cosine estimator
-		float rand1 = (*dis_)(*gen_);
-		float rand2 = (*dis_)(*gen_);
-
-		// Uniform distribution over a hemisphere
-		float inclination = acos(sqrt(rand1));//glm::acos(1 - rand1);//glm::acos(1 -  2 * (*dis_)(*gen_));
-		float azimuth = 2 * M_PI * rand2;
-		// Change the actual vector
-		glm::vec3 random_direction = id.normal;
-		random_direction = glm::normalize(glm::rotate(
-			random_direction,
-			inclination,
-			tangent));
-		random_direction = glm::normalize(glm::rotate(
-			random_direction,
-			azimuth,
-			id.normal));
+		glm::vec3 random_direction = warp::cosineHemisphere(id.normal, sampler->next2D());
 
 		float cos_angle = glm::dot(random_direction, id.normal);
 		float g = cos_angle / M_PI;
@@ -249,8 +318,10 @@ SpectralDistribution Scene::traceIndirectDiffuseRay(
 		}
 
 		r.direction = random_direction;
+		r.has_bounced_diffusely = true;
+		r.diffuse_pdf = g;
 		r.radiance *= M_PI * brdf; // Importance, M_PI is because of the importance sampling
-		L_indirect += traceRay(r, render_mode, iteration + 1) * M_PI * brdf;
+		L_indirect += traceRay(r, render_mode, sampler, iteration + 1) * M_PI * brdf;
 	}
 	return L_indirect / n_samples;
 }
@@ -258,6 +329,7 @@ SpectralDistribution Scene::traceIndirectDiffuseRay(
 SpectralDistribution Scene::traceSpecularRay(
 	Ray r,
 	int render_mode,
+	Sampler* sampler,
 	IntersectionData id,
 	int iteration)
 {
@@ -265,16 +337,18 @@ SpectralDistribution Scene::traceSpecularRay(
 	SpectralDistribution specular = SpectralDistribution();
 
 	r.direction = glm::reflect(r.direction, id.normal);
+	r.diffuse_pdf = 0;
 	SpectralDistribution brdf = evaluatePerfectBRDF(id.material.color_specular * id.material.reflectance * id.material.specular_reflectance);
 	r.radiance *= brdf;
 	// Recursively trace the reflected ray
-	specular += traceRay(r, render_mode, iteration + 1) * brdf;
+	specular += traceRay(r, render_mode, sampler, iteration + 1) * brdf;
 	return specular;
 }
 
 SpectralDistribution Scene::traceRefractedRay(
 	Ray r,
 	int render_mode,
+	Sampler* sampler,
 	IntersectionData id,
 	int iteration,
 	glm::vec3 offset,
@@ -282,6 +356,7 @@ SpectralDistribution Scene::traceRefractedRay(
 {
 	Ray recursive_ray = r;
 	recursive_ray.has_intersected = true;
+	recursive_ray.diffuse_pdf = 0;
 
 	glm::vec3 normal = inside ? -id.normal : id.normal;
 	glm::vec3 perfect_refraction = glm::refract(
@@ -324,8 +399,8 @@ SpectralDistribution Scene::traceRefractedRay(
 		recursive_ray_refracted.radiance *= brdf_refractive;
 
 		// Recursively trace the refracted rays
-		SpectralDistribution reflected_part = traceRay(recursive_ray_reflected, render_mode, iteration + 1) * brdf_specular;
-		SpectralDistribution refracted_part = traceRay(recursive_ray_refracted, render_mode, iteration + 1) * brdf_refractive;
+		SpectralDistribution reflected_part = traceRay(recursive_ray_reflected, render_mode, sampler, iteration + 1) * brdf_specular;
+		SpectralDistribution refracted_part = traceRay(recursive_ray_refracted, render_mode, sampler, iteration + 1) * brdf_refractive;
 		return reflected_part + refracted_part;
 	}
 	else
@@ -339,33 +414,305 @@ SpectralDistribution Scene::traceRefractedRay(
 		recursive_ray.direction = perfect_reflection;
 		recursive_ray.radiance *= brdf_specular;
 		// Recursively trace the reflected ray
-		return traceRay(recursive_ray, render_mode, iteration + 1) * brdf_specular;
+		return traceRay(recursive_ray, render_mode, sampler, iteration + 1) * brdf_specular;
 	}
 }
 
-SpectralDistribution Scene::traceRay(Ray r, int render_mode, int iteration)
+SpectralDistribution Scene::evaluateLampHit(
+	const Ray& r,
+	const LightSourceIntersectionData& lamp_id,
+	int render_mode) const
 {
-	IntersectionData id;
-	LightSourceIntersectionData lamp_id;
+	switch (render_mode)
+	{
+		case WHITTED_SPECULAR :
+			return lamp_id.radiosity / (M_PI * 2);
+		case COMPOSITE :
+			return lamp_id.radiosity / (M_PI * 2) * r.emission_weight;
+		case MONTE_CARLO :
+		case FINAL_GATHERING :
+		{
+			// Only lamps found directly by a diffuse bounce, those are the
+			// paths that are also sampled with shadow rays. The rest are
+			// caustics and come from the caustics pass.
+			float cos_light_angle = glm::dot(lamp_id.normal, -r.direction);
+			if (!r.diffuse_pdf || cos_light_angle <= 0)
+				return SpectralDistribution();
+			float light_pdf = lamp_id.selection_probability * lamp_id.t * lamp_id.t /
+				(lamp_id.area * cos_light_angle);
+			return lamp_id.radiosity / (M_PI * 2) * powerHeuristic(r.diffuse_pdf, light_pdf);
+		}
+		default :
+			return SpectralDistribution();
+	}
+}
 
-	if (intersectLamp(&lamp_id, r)) // Ray hit light source
-		switch (render_mode)
+// Traces the branches of a camera path depth first
+struct Scene::BranchStackSink : public Scene::PathVertexSink
+{
+	BranchStackSink(Scene* scene, Sampler* sampler) : scene(scene), sampler(sampler) {};
+	void addRadiance(const SpectralDistribution& radiance)
+	{
+		L += radiance;
+	}
+	void addBranch(const Ray& r, int render_mode, int iteration)
+	{
+		branches.push(r, render_mode, iteration, sampler);
+	}
+	void addShadowRay(
+		const ShadowRay& shadow_ray,
+		glm::vec3 direction_out,
+		const IntersectionData& id,
+		const SpectralDistribution& throughput)
+	{
+		LightSourceIntersectionData lamp_id;
+		if (scene->intersectLamp(&lamp_id, shadow_ray.ray))
+			L += throughput * scene->evaluateShadowRay(direction_out, id, shadow_ray, lamp_id);
+	}
+
+	Scene* scene;
+	Sampler* sampler;
+	BranchStack branches;
+	SpectralDistribution L;
+};
+
+SpectralDistribution Scene::tracePath(
+	Ray r,
+	int render_mode,
+	Sampler* sampler)
+{
+	BranchStackSink sink(this, sampler);
+	RayCounters& counters = getRayCounters();
+	counters.paths++;
+	sink.addBranch(r, render_mode, 0);
+
+	while (!sink.branches.empty())
+	{
+		// Copied since pushing overwrites the slot
+		Branch branch = sink.branches.pop();
+
+		counters.rays++;
+		IntersectionData id;
+		LightSourceIntersectionData lamp_id;
+		if (intersectLamp(&lamp_id, branch.ray))
+		{
+			sink.addRadiance(branch.ray.radiance *
+				evaluateLampHit(branch.ray, lamp_id, branch.render_mode));
+			continue;
+		}
+		if (!intersect(&id, branch.ray))
+			continue;
+		counters.vertices++;
+		shadeSurface(branch.ray, id, branch.render_mode, branch.iteration, sampler, &sink);
+	}
+	return sink.L;
+}
+
+void Scene::shadeSurface(
+	Ray ray,
+	const IntersectionData& id,
+	int mode,
+	int iteration,
+	Sampler* sampler,
+	PathVertexSink* sink)
+{
+	// Russian roulette
+	float random = sampler->next1D();
+	float non_termination_probability = getSurvivalProbability(ray, mode, iteration);
+	if (random >= non_termination_probability)
+		return;
+	ray.radiance /= non_termination_probability;
+
+	// To make sure it does not intersect with itself again
+	glm::vec3 offset = id.normal * 0.00001f;
+	bool inside = glm::dot(id.normal, ray.direction) > 0;
+	glm::vec3 position = ray.origin + id.t * ray.direction;
+
+	float transmissivity = id.material.transmissivity;
+	float specularity = id.material.specular_reflectance;
+	float reflection_factor =
+		id.material.reflectance * id.material.specular_reflectance;
+
+	// Branches are added in the reverse order of traceRay(), tracePath()
+	// traces the last one first
+	if (transmissivity)
+	{ // Completely or partly transmissive
+		Ray transmitted = ray;
+		transmitted.has_intersected = true;
+		transmitted.diffuse_pdf = 0;
+		transmitted.radiance *= transmissivity;
+
+		glm::vec3 normal = inside ? -id.normal : id.normal;
+		glm::vec3 side_offset = inside ? -offset : offset;
+		glm::vec3 perfect_refraction = glm::refract(
+			ray.direction,
+			normal,
+			ray.material.refraction_index / id.material.refraction_index);
+		glm::vec3 perfect_reflection = glm::reflect(ray.direction, id.normal);
+		bool reflect = true;
+		if (perfect_refraction != glm::vec3(0))
+		{ // Refraction and reflection
+			// Schlicks approximation to Fresnels equations.
+			float n1 = ray.material.refraction_index;
+			float n2 = id.material.refraction_index;
+			float R_0 = pow((n1 - n2)/(n1 + n2), 2);
+			float R = R_0 + (1 - R_0) * pow(1 - glm::dot(normal, -ray.direction),5);
+			if (stochastic_fresnel_)
+			{
+				// Only one of the branches is traced, picked with the
+				// probability of its Fresnel weight which then cancels
+				R = sampler->next1D() < R ? 1 : 0;
+			}
+
+			if (R < 1)
+			{
+				Ray refracted = transmitted;
+				refracted.material = id.material;
+				refracted.origin = position - side_offset;
+				refracted.direction = perfect_refraction;
+				refracted.radiance *= evaluatePerfectBRDF(
+					id.material.color_diffuse * reflection_factor * (1 - R));
+				sink->addBranch(refracted, mode, iteration + 1);
+			}
+			reflect = R > 0;
+
+			transmitted.material = Material::air();
+			transmitted.radiance *= evaluatePerfectBRDF(
+				id.material.color_specular * reflection_factor * R);
+		}
+		else
+		{ // Brewster angle reached, complete specular reflection
+			transmitted.radiance *= evaluatePerfectBRDF(
+				id.material.color_specular * reflection_factor);
+		}
+		if (reflect)
+		{
+			transmitted.origin = position + side_offset;
+			transmitted.direction = perfect_reflection;
+			sink->addBranch(transmitted, mode, iteration + 1);
+		}
+	}
+	if (1 - transmissivity)
+	{ // Completely or partly reflected
+		Ray reflected = ray;
+		reflected.origin = position + (inside ? -offset : offset);
+		reflected.radiance *= 1 - transmissivity;
+
+		// The render mode of the diffuse vertex, if there is one
+		int diffuse_mode = -1;
+		float diffuse_weight = 1;
+		switch (mode)
 		{
-			case WHITTED_SPECULAR :
-				return lamp_id.radiosity / (M_PI * 2);
+			case CAUSTICS :
+				sink->addRadiance(reflected.radiance * gatherCausticRadiance(ray, id, position + offset));
+				break;
+			case COMPOSITE :
+				// The diffuse render mode takes over from the first diffuse
+				// vertex of the camera path
+				if (ray.caustics_weight)
+				{
+					sink->addRadiance(reflected.radiance * ray.caustics_weight *
+						gatherCausticRadiance(ray, id, position + offset));
+				}
+				if (ray.diffuse_weight && (1 - specularity))
+				{
+					diffuse_mode = diffuse_render_mode_;
+					diffuse_weight = ray.diffuse_weight;
+				}
+				break;
+			case FINAL_GATHERING :
+				if (!(1 - specularity))
+					break;
+				if (ray.has_bounced_diffusely)
+					sink->addRadiance(reflected.radiance * evaluateGlobalRadiance(ray, id, reflected.origin));
+				else
+					diffuse_mode = mode;
+				break;
+			case MONTE_CARLO :
+				if (1 - specularity)
+					diffuse_mode = mode;
+				break;
 			default :
-				return SpectralDistribution();
+				break;
 		}
+
+		if (diffuse_mode >= 0)
+		{
+			Ray diffuse = reflected;
+			diffuse.has_intersected = true;
+			// The first diffuse vertex of a camera path is split in to
+			// several samples, each with its share of the throughput
+			int n_splits = ray.has_bounced_diffusely ? 1 : first_bounce_splits_;
+			diffuse.radiance *= diffuse_weight / n_splits;
+			for (int i = 0; i < n_splits; ++i)
+			{
+				// Local illumination (shadow rays)
+				if (lamps_.size())
+				{
+					getRayCounters().rays++;
+					ShadowRay shadow_ray;
+					if (sampleShadowRay(diffuse, id, sampler, &shadow_ray))
+						sink->addShadowRay(shadow_ray, -ray.direction, id, diffuse.radiance);
+				}
+				// Indirect illumination, cosine weighted so only the brdf
+				// is left of the integrand
+				Ray indirect = diffuse;
+				indirect.direction = warp::cosineHemisphere(id.normal, sampler->next2D());
+				indirect.has_bounced_diffusely = true;
+				indirect.diffuse_pdf = glm::dot(indirect.direction, id.normal) / M_PI;
+				indirect.radiance *= M_PI * evaluateDiffuseBRDF(
+					-ray.direction,
+					indirect.direction,
+					id.normal,
+					id.material);
+				sink->addBranch(indirect, diffuse_mode, iteration + 1);
+			}
+		}
+
+		if (specularity)
+		{
+			reflected.has_intersected = true;
+			reflected.direction = glm::reflect(ray.direction, id.normal);
+			reflected.diffuse_pdf = 0;
+			reflected.radiance *= evaluatePerfectBRDF(
+				id.material.color_specular * reflection_factor);
+			sink->addBranch(reflected, mode, iteration + 1);
+		}
+	}
+}
+
+SpectralDistribution Scene::traceRay(
+	Ray r,
+	int render_mode,
+	Sampler* sampler,
+	int iteration)
+{
+	IntersectionData id;
+	LightSourceIntersectionData lamp_id;
+
+	bool light_path = render_mode == PHOTON_MAPPING || render_mode == PROGRESSIVE_PHOTON_MAPPING;
+	if (!light_path)
+	{
+		RayCounters& counters = getRayCounters();
+		counters.rays++;
+		if (iteration == 0)
+			counters.paths++;
+	}
+
+	if (intersectLamp(&lamp_id, r)) // Ray hit light source
+		return evaluateLampHit(r, lamp_id, render_mode);
 	else if (intersect(&id, r))
 	{ // Ray hit another object
+		if (!light_path)
+			getRayCounters().vertices++;
 		// Russian roulette
-		float random = (*dis_)(*gen_);
-		//float non_termination_probability = glm::max((1 - float(iteration) / 10), 0.5f);
-		float non_termination_probability = iteration == 0 ? 1.0 : 0.8;
-		if (random > non_termination_probability || iteration > 20)
+		float random = sampler->next1D();
+		float non_termination_probability = getSurvivalProbability(r, render_mode, iteration);
+		if (random >= non_termination_probability)
 			return SpectralDistribution();
-		//if (iteration >= 4)
-		//	return SpectralDistribution();
+		// The throughput of the path includes the survival probabilities, so
+		// it stays an unbiased weight for photons and for later roulette
+		r.radiance /= non_termination_probability;
 
 		// To make sure it does not intersect with itself again
 		glm::vec3 offset = id.normal * 0.00001f;
@@ -390,6 +737,7 @@ SpectralDistribution Scene::traceRay(Ray r, int render_mode, int iteration)
 					traceSpecularRay(
 						recursive_ray,
 						render_mode,
+						sampler,
 						id,
 						iteration) :
 					SpectralDistribution();
@@ -397,76 +745,49 @@ SpectralDistribution Scene::traceRay(Ray r, int render_mode, int iteration)
 			switch (render_mode)
 			{
 				case PHOTON_MAPPING :
+				case PROGRESSIVE_PHOTON_MAPPING :
 				{
-					if (r.has_intersected)
+					Photon p;
+					p.position = recursive_ray.origin;
+					p.direction_in = -r.direction;
+
+					float photon_area = Photon::RADIUS * Photon::RADIUS * M_PI;
+					// The projected area should be photon area times cos theta,
+					// This is avoided both here and later to avoid numerical problem
+					// when dividing with small numbers.
+					float projected_area = photon_area;// * glm::dot(p.direction_in, id.normal);
+					float solid_angle = M_PI;
+		
+					p.delta_flux = recursive_ray.radiance * projected_area * solid_angle;
+
+					// Caustic paths, light to specular to diffuse (LS+D)
+					if (render_mode == PHOTON_MAPPING &&
+						r.has_intersected && !r.has_bounced_diffusely)
+						caustic_map_.store(p, sampler->getStreamPosition());
+
+					if (1 - specularity)
 					{
-						Photon p;
-						p.position = recursive_ray.origin;
-						p.direction_in = -r.direction;
-
-						float photon_area = Photon::RADIUS * Photon::RADIUS * M_PI;
-						// The projected area should be photon area times cos theta,
-						// This is avoided both here and later to avoid numerical problem
-						// when dividing with small numbers.
-						float projected_area = photon_area;// * glm::dot(p.direction_in, id.normal);
-						float solid_angle = M_PI;
-			
-						p.delta_flux = recursive_ray.radiance / non_termination_probability * projected_area * solid_angle;
-
-						KDTreeNode to_insert;
-						to_insert.p = p;
-
-						photon_map_.insert(to_insert);
+						global_map_.store(p, sampler->getStreamPosition());
+						if (render_mode == PHOTON_MAPPING &&
+							sampler->next1D() * IRRADIANCE_SAMPLE_RATE < 1)
+						{ // Irradiance is estimated here later
+							Photon irradiance_photon;
+							irradiance_photon.position = p.position;
+							irradiance_photon.direction_in = inside ? -id.normal : id.normal;
+							irradiance_map_.store(irradiance_photon, sampler->getStreamPosition());
+						}
+
+						// Continue the path diffusely to populate the global map
+						Ray diffuse_ray = recursive_ray;
+						diffuse_ray.has_intersected = true;
+						traceIndirectDiffuseRay(diffuse_ray, render_mode, sampler, id, iteration);
 					}
 					break;
 				}
 				case CAUSTICS :
 				{
-					KDTreeNode ref_node;
-					ref_node.p.position = r.origin + r.direction * id.t + offset;
-
-					std::vector<KDTreeNode> closest_photons;
-					photon_map_.find_within_range(ref_node,Photon::RADIUS,std::back_insert_iterator<std::vector<KDTreeNode> >(closest_photons));
-					
-					SpectralDistribution photon_radiance;
-					for (int i = 0; i < closest_photons.size(); ++i)
-					{
-						SpectralDistribution brdf;
-						if (id.material.diffuse_roughness)
-						{
-							brdf = evaluateOrenNayarBRDF(
-								-r.direction,
-								closest_photons[i].p.direction_in,
-								id.normal,
-								id.material.color_diffuse * id.material.reflectance * (1 - id.material.specular_reflectance),
-								id.material.diffuse_roughness);
-						}
-						else
-						{
-							brdf = evaluateLambertianBRDF(
-								-r.direction,
-								closest_photons[i].p.direction_in,
-								id.normal,
-								id.material.color_diffuse * id.material.reflectance * (1 - id.material.specular_reflectance));
-						}
-
-						float distance = glm::length(closest_photons[i].p.position - ref_node.p.position);
-						// The area of the photon if its inclination angle
-						// is 90 degrees and the surface is flat.
-						//float cos_theta = glm::max(glm::dot(closest_photons[i].p.direction_in, id.normal), 0.0f);
-						float photon_area = Photon::RADIUS * Photon::RADIUS * M_PI;
-						float projected_area = photon_area;// * cos_theta;
-						photon_radiance +=
-							// flux / area / steradian = radiance
-							closest_photons[i].p.delta_flux *
-							(glm::length(distance) < Photon::RADIUS ? 1 : 0)
-							/ (projected_area * 2 * M_PI)
-							//
-							* brdf // The brdf is part of the integral of the rendering equation
-							* (2 * M_PI); // Integration over the whole hemisphere get us back to radiance
-					}
-
-					diffuse_part = photon_radiance;
+					glm::vec3 position = r.origin + r.direction * id.t + offset;
+					diffuse_part = gatherCausticRadiance(r, id, position);
 					break;
 				}
 				case WHITTED_SPECULAR :
@@ -474,6 +795,42 @@ SpectralDistribution Scene::traceRay(Ray r, int render_mode, int iteration)
 					diffuse_part = SpectralDistribution();
 					break;
 				}
+				case COMPOSITE :
+				{
+					// Only the camera path up to its first diffuse vertex is
+					// traced in this mode, the diffuse render mode takes over
+					// from there
+					if (r.caustics_weight)
+					{
+						glm::vec3 position = r.origin + r.direction * id.t + offset;
+						diffuse_part += gatherCausticRadiance(r, id, position) * r.caustics_weight;
+					}
+					if (r.diffuse_weight && (1 - specularity))
+					{
+						diffuse_part += traceDiffuseRay(
+							recursive_ray,
+							diffuse_render_mode_,
+							sampler,
+							id,
+							iteration) * r.diffuse_weight;
+					}
+					break;
+				}
+				case FINAL_GATHERING :
+				{
+					if (!(1 - specularity))
+						diffuse_part = SpectralDistribution();
+					else if (r.has_bounced_diffusely)
+						diffuse_part = evaluateGlobalRadiance(r, id, recursive_ray.origin);
+					else
+						diffuse_part = traceDiffuseRay(
+							recursive_ray,
+							render_mode,
+							sampler,
+							id,
+							iteration);
+					break;
+				}
 				case MONTE_CARLO :
 				{
 					diffuse_part =
@@ -481,6 +838,7 @@ SpectralDistribution Scene::traceRay(Ray r, int render_mode, int iteration)
 							traceDiffuseRay(
 								recursive_ray,
 								render_mode,
+								sampler,
 								id,
 								iteration) :
 							SpectralDistribution();
@@ -500,7 +858,7 @@ SpectralDistribution Scene::traceRay(Ray r, int render_mode, int iteration)
 		if (transmissivity)
 		{ // Completely or partly transmissive
 			SpectralDistribution transmitted_part =
-				traceRefractedRay(r, render_mode, id, iteration, offset, inside);
+				traceRefractedRay(r, render_mode, sampler, id, iteration, offset, inside);
 			total += transmitted_part * transmissivity;
 		}
 		return total / non_termination_probability;
@@ -508,60 +866,423 @@ SpectralDistribution Scene::traceRay(Ray r, int render_mode, int iteration)
 	return SpectralDistribution();
 }
 
+float Scene::getSurvivalProbability(const Ray& r, int render_mode, int iteration) const
+{
+	if (render_mode == PHOTON_MAPPING || render_mode == PROGRESSIVE_PHOTON_MAPPING)
+	{
+		// The flux of a photon is only reduced by surface colors, it is not
+		// worth terminating photons on it
+		if (iteration > 20)
+			return 0;
+		return iteration == 0 ? 1.0 : 0.8;
+	}
+	if (iteration >= max_path_depth_)
+		return 0;
+	if (iteration < min_path_depth_)
+		return 1;
+	// The largest channel of the path throughput (importance), paths that
+	// can only add little to the pixel are more likely to end
+	float throughput = glm::max(r.radiance.data[0], glm::max(r.radiance.data[1], r.radiance.data[2]));
+	return glm::clamp(throughput, 0.0f, 1.0f);
+}
+
+SpectralDistribution Scene::gatherCausticRadiance(
+	Ray r,
+	IntersectionData id,
+	glm::vec3 position)
+{
+	// Reused by each thread, and allocated by it so it is in its own memory
+	thread_local std::vector<const CompactPhoton*> closest_photons;
+	closest_photons.clear();
+	caustic_map_.findWithinRange(position, Photon::RADIUS, &closest_photons);
+	
+	SpectralDistribution photon_radiance;
+	for (int i = 0; i < closest_photons.size(); ++i)
+	{
+		SpectralDistribution brdf;
+		if (id.material.diffuse_roughness)
+		{
+			brdf = evaluateOrenNayarBRDF(
+				-r.direction,
+				closest_photons[i]->direction(),
+				id.normal,
+				id.material.color_diffuse * id.material.reflectance * (1 - id.material.specular_reflectance),
+				id.material.diffuse_roughness);
+		}
+		else
+		{
+			brdf = evaluateLambertianBRDF(
+				-r.direction,
+				closest_photons[i]->direction(),
+				id.normal,
+				id.material.color_diffuse * id.material.reflectance * (1 - id.material.specular_reflectance));
+		}
+
+		float distance = glm::length(closest_photons[i]->position - position);
+		// The area of the photon if its inclination angle
+		// is 90 degrees and the surface is flat.
+		//float cos_theta = glm::max(glm::dot(closest_photons[i]->direction(), id.normal), 0.0f);
+		float photon_area = Photon::RADIUS * Photon::RADIUS * M_PI;
+		float projected_area = photon_area;// * cos_theta;
+		photon_radiance +=
+			// flux / area / steradian = radiance
+			closest_photons[i]->deltaFlux() *
+			(glm::length(distance) < Photon::RADIUS ? 1 : 0)
+			/ (projected_area * 2 * M_PI)
+			//
+			* brdf // The brdf is part of the integral of the rendering equation
+			* (2 * M_PI); // Integration over the whole hemisphere get us back to radiance
+	}
+	return photon_radiance;
+}
+
+void Scene::emitPhotons(
+	const int first_photon,
+	const int n_photons,
+	const int n_photons_total,
+	const int sample_index,
+	int render_mode)
+{
+	ThreadPool::instance().parallelFor(0, n_photons, 256, [&](int i, int thread)
+	{
+		// The photons of all calls with the same sample_index are stratified
+		// together over lamp area and direction
+		StratifiedSampler photon_sampler(Sampler::PHOTON_SEED);
+		photon_sampler.startSample(sample_index, first_photon + i, n_photons_total);
+		Sampler* sampler = &photon_sampler;
+
+		// Pick a light source. Bigger flux => Bigger chance to be picked.
+		int picked_light_source = lamp_selection_.sample(sampler->next1D());
+		LightSource* lamp = lamps_[picked_light_source];
+
+		Ray r = lamp->shootLightRay(sampler);
+		r.has_intersected = false;
+		// Compute delta_flux based on the flux of the light source
+		SpectralDistribution delta_flux =
+			lamp->radiosity * lamp->getArea() /
+			(lamp_selection_.probability(picked_light_source) * n_photons_total);
+		float photon_area = Photon::RADIUS * Photon::RADIUS * M_PI;
+		float solid_angle = (M_PI * 2);
+		r.radiance = delta_flux / (photon_area * solid_angle);
+		traceRay(r, render_mode, sampler);
+	});
+}
+
 void Scene::buildPhotonMap(const int n_photons)
 {
 	if (lamps_.size())
 	{
-		SpectralDistribution total_flux = SpectralDistribution();
-		float total_flux_norm = 0;
-		for (int i = 0; i < lamps_.size(); ++i)
+		for (int k = 0; k < 100; ++k)
 		{
-			total_flux_norm += lamps_[i]->radiosity.norm() * lamps_[i]->getArea();
-			total_flux += lamps_[i]->radiosity * lamps_[i]->getArea();
+			emitPhotons(k * (n_photons / 100), n_photons / 100, n_photons, 0, PHOTON_MAPPING);
+			std::cout << k << "\% of photon map finished." << std::endl;
 		}
-		for (int k = 0; k < 100; ++k)
+		std::cout << "Number of caustic photons in scene: " << caustic_map_.size() << std::endl;
+		std::cout << "Number of global photons in scene: " << global_map_.size() << std::endl;
+		std::cout << "Balancing kd trees" << std::endl;
+		caustic_map_.balance();
+		global_map_.balance();
+		irradiance_map_.balance();
+		std::cout << "Precomputing irradiance at " << irradiance_map_.size() << " photons" << std::endl;
+		precomputeIrradiance();
+		// Lookups only use the irradiance photons from now on
+		global_map_.clear();
+		std::cout << "Photon map memory usage: " <<
+			(caustic_map_.memoryUsage() + irradiance_map_.memoryUsage()) / (1024 * 1024) <<
+			" MB" << std::endl;
+	}
+	else
+	{
+		std::cout << "No lightsource in the scene. Could not build photon map." << std::endl;
+	}
+}
+
+void Scene::buildProgressivePhotonMap(const int n_photons, const int pass)
+{
+	global_map_.clear();
+	if (lamps_.size())
+	{
+		emitPhotons(0, n_photons, n_photons, pass, PROGRESSIVE_PHOTON_MAPPING);
+		global_map_.balance();
+	}
+}
+
+SpectralDistribution Scene::gatherPhotons(
+	const VisiblePoint& vp,
+	float radius,
+	int* n_photons)
+{
+	thread_local std::vector<const CompactPhoton*> photons;
+	photons.clear();
+	global_map_.findWithinRange(vp.position, radius, &photons);
+
+	SpectralDistribution flux;
+	*n_photons = 0;
+	for (int i = 0; i < photons.size(); ++i)
+	{
+		glm::vec3 direction = photons[i]->direction();
+		if (glm::dot(direction, vp.normal) > 0)
 		{
-			#pragma omp parallel for
-			for (int i = 0; i < n_photons / 100; ++i)
-			{
-				// Pick a light source. Bigger flux => Bigger chance to be picked.
-				int picked_light_source = 0;
-				float accumulating_chance = 0;
-				float random = (*dis_)(*gen_);
-				for (int i = 0; i < lamps_.size(); ++i)
-				{
-					float interval =
-						lamps_[i]->radiosity.norm() *
-						lamps_[i]->getArea() /
-						total_flux_norm;
-					if (random > accumulating_chance && random < accumulating_chance + interval)
-					{ // This lamp got picked
-						picked_light_source = i;
-						break;
-					}
-					else
-						accumulating_chance += interval; 
-				}
+			flux += photons[i]->deltaFlux() *
+				evaluateDiffuseBRDF(vp.direction_out, direction, vp.normal, vp.material);
+			(*n_photons)++;
+		}
+	}
+	return flux;
+}
+
+bool Scene::traceVisiblePoint(Ray r, Sampler* sampler, VisiblePoint* vp)
+{
+	// Follow the camera path through specular reflections and refractions,
+	// choosing one branch at random at each surface, until it is absorbed by
+	// a diffuse surface. The branch probabilities are the weights used in
+	// traceRay() so the path weight only gets the surface colors.
+	SpectralDistribution weight = r.radiance;
+	for (int iteration = 0; iteration <= 20; ++iteration)
+	{
+		IntersectionData id;
+		LightSourceIntersectionData lamp_id;
+		if (intersectLamp(&lamp_id, r) || !intersect(&id, r))
+			return false;
 
-				Ray r = lamps_[picked_light_source]->shootLightRay();
-				r.has_intersected = false;
-				// Compute delta_flux based on the flux of the light source
-				SpectralDistribution delta_flux = total_flux / n_photons;
-				float photon_area = Photon::RADIUS * Photon::RADIUS * M_PI;
-				float solid_angle = (M_PI * 2);
-				r.radiance = delta_flux / (photon_area * solid_angle);
-				traceRay(r, PHOTON_MAPPING);
+		glm::vec3 offset = id.normal * 0.00001f;
+		bool inside = glm::dot(id.normal, r.direction) > 0;
+		glm::vec3 normal = inside ? -id.normal : id.normal;
+		glm::vec3 position = r.origin + id.t * r.direction;
+
+		float transmissivity = id.material.transmissivity;
+		float specularity = id.material.specular_reflectance;
+		float random = sampler->next1D();
+		if (random >= transmissivity)
+		{ // Reflected
+			random = sampler->next1D();
+			if (random >= specularity)
+			{ // Diffuse, the path ends here
+				vp->position = position + normal * 0.00001f;
+				vp->normal = normal;
+				vp->direction_out = -r.direction;
+				vp->material = id.material;
+				vp->weight = weight / (1 - specularity);
+				return true;
+			}
+			weight *= id.material.color_specular * id.material.reflectance;
+			r.origin = position + (inside ? -offset : offset);
+			r.direction = glm::reflect(r.direction, id.normal);
+		}
+		else
+		{ // Transmitted
+			glm::vec3 perfect_refraction = glm::refract(
+				r.direction,
+				normal,
+				r.material.refraction_index / id.material.refraction_index);
+			float R = 1;
+			if (perfect_refraction != glm::vec3(0))
+			{
+				// Schlicks approximation to Fresnels equations.
+				float n1 = r.material.refraction_index;
+				float n2 = id.material.refraction_index;
+				float R_0 = pow((n1 - n2)/(n1 + n2), 2);
+				R = R_0 + (1 - R_0) * pow(1 - glm::dot(normal, -r.direction),5);
+			}
+			glm::vec3 transmitted_offset = inside ? -offset : offset;
+			random = sampler->next1D();
+			if (random < R)
+			{ // Reflected
+				weight *= id.material.color_specular * id.material.reflectance * id.material.specular_reflectance;
+				if (perfect_refraction != glm::vec3(0))
+					r.material = Material::air();
+				r.origin = position + transmitted_offset;
+				r.direction = glm::reflect(r.direction, id.normal);
+			}
+			else
+			{ // Refracted
+				weight *= id.material.color_diffuse * id.material.reflectance * id.material.specular_reflectance;
+				r.material = id.material;
+				r.origin = position - transmitted_offset;
+				r.direction = perfect_refraction;
 			}
-			std::cout << k << "\% of photon map finished." << std::endl;
 		}
-		std::cout << "Number of photons in scene: " << photon_map_.size() << std::endl;
-		std::cout << "Optimizing kd tree" << std::endl;
-		photon_map_.optimize();
+	}
+	return false;
+}
+
+void Scene::precomputeIrradiance()
+{
+	ThreadPool::instance().parallelFor(0, irradiance_map_.size(), 256, [&](int i, int thread)
+	{
+		CompactPhoton& p = irradiance_map_[i];
+		p.setDeltaFlux(global_map_.estimateIrradiance(
+			p.position,
+			p.direction(),
+			Photon::RADIUS));
+	});
+}
+
+SpectralDistribution Scene::evaluateGlobalRadiance(
+	Ray r,
+	IntersectionData id,
+	glm::vec3 position)
+{
+	glm::vec3 normal = glm::dot(id.normal, r.direction) > 0 ? -id.normal : id.normal;
+	const CompactPhoton* p = irradiance_map_.findNearest(
+		position,
+		normal,
+		Photon::RADIUS);
+	if (!p)
+		return SpectralDistribution();
+
+	SpectralDistribution brdf;
+	if (id.material.diffuse_roughness)
+	{
+		brdf = evaluateOrenNayarBRDF(
+			-r.direction,
+			normal,
+			normal,
+			id.material.color_diffuse * id.material.reflectance * (1 - id.material.specular_reflectance),
+			id.material.diffuse_roughness);
 	}
 	else
 	{
-		std::cout << "No lightsource in the scene. Could not build photon map." << std::endl;
+		brdf = evaluateLambertianBRDF(
+			-r.direction,
+			normal,
+			normal,
+			id.material.color_diffuse * id.material.reflectance * (1 - id.material.specular_reflectance));
+	}
+	// Irradiance times brdf is the reflected radiance
+	return p->deltaFlux() * brdf;
+}
+
+namespace
+{
+	// 64 bit FNV-1a
+	const unsigned long long FNV_OFFSET_BASIS = 14695981039346656037ULL;
+	const unsigned long long FNV_PRIME = 1099511628211ULL;
+
+	unsigned long long hashBytes(
+		unsigned long long hash,
+		const char* data,
+		size_t size)
+	{
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= (unsigned char)data[i];
+			hash *= FNV_PRIME;
+		}
+		return hash;
+	}
+
+	unsigned long long hashFile(unsigned long long hash, const std::string& file_path)
+	{
+		std::ifstream file(file_path.c_str(), std::ios::binary);
+		char buffer[1 << 16];
+		while (file.read(buffer, sizeof(buffer)) || file.gcount())
+			hash = hashBytes(hash, buffer, file.gcount());
+		return hash;
 	}
+
+	const char PHOTON_MAP_MAGIC[4] = {'P', 'M', 'A', 'P'};
+	const unsigned int PHOTON_MAP_VERSION = 2;
+}
+
+unsigned long long Scene::getSceneKey()
+{
+	unsigned long long hash = FNV_OFFSET_BASIS;
+	hash = hashFile(hash, file_path_);
+	for (int i = 0; i < mesh_file_paths_.size(); ++i)
+		hash = hashFile(hash, mesh_file_paths_[i]);
+	return hash;
+}
+
+unsigned long long Scene::getPhotonMapKey(const int n_photons)
+{
+	unsigned long long hash = getSceneKey();
+	// Anything that changes the content of the maps
+	int parameters[] = {
+		n_photons,
+		IRRADIANCE_SAMPLE_RATE,
+		int(sizeof(CompactPhoton)),
+		int(Photon::RADIUS * 1000000)};
+	return hashBytes(hash, reinterpret_cast<const char*>(parameters), sizeof(parameters));
+}
+
+bool Scene::writePhotonMap(std::ostream& os, const int n_photons)
+{
+	unsigned long long key = getPhotonMapKey(n_photons);
+	os.write(PHOTON_MAP_MAGIC, sizeof(PHOTON_MAP_MAGIC));
+	os.write(reinterpret_cast<const char*>(&PHOTON_MAP_VERSION), sizeof(PHOTON_MAP_VERSION));
+	os.write(reinterpret_cast<const char*>(&key), sizeof(key));
+	caustic_map_.write(os);
+	irradiance_map_.write(os);
+	return bool(os);
+}
+
+bool Scene::readPhotonMap(std::istream& is, const int n_photons)
+{
+	char magic[sizeof(PHOTON_MAP_MAGIC)];
+	unsigned int version;
+	unsigned long long key;
+	is.read(magic, sizeof(magic));
+	is.read(reinterpret_cast<char*>(&version), sizeof(version));
+	is.read(reinterpret_cast<char*>(&key), sizeof(key));
+	if (!is ||
+		!std::equal(magic, magic + sizeof(magic), PHOTON_MAP_MAGIC) ||
+		version != PHOTON_MAP_VERSION ||
+		key != getPhotonMapKey(n_photons))
+	{
+		std::cout << "Photon map does not match the scene." << std::endl;
+		return false;
+	}
+	if (!caustic_map_.read(is) || !irradiance_map_.read(is))
+	{
+		caustic_map_.clear();
+		irradiance_map_.clear();
+		return false;
+	}
+	return true;
+}
+
+bool Scene::savePhotonMap(const char* file_path, const int n_photons)
+{
+	// Written under a name of its own and renamed, so processes that render
+	// the same scene at the same time never load a partly written map
+	std::string temporary_file_path =
+		std::string(file_path) + "." + std::to_string(getpid()) + ".tmp";
+	std::ofstream file(temporary_file_path.c_str(), std::ios::binary);
+	if (!file)
+	{
+		std::cout << "Could not open " << temporary_file_path << " for writing." << std::endl;
+		return false;
+	}
+	if (!writePhotonMap(file, n_photons) || !file.flush())
+	{
+		std::cout << "Could not write photon map to " << file_path << "." << std::endl;
+		remove(temporary_file_path.c_str());
+		return false;
+	}
+	file.close();
+	if (rename(temporary_file_path.c_str(), file_path) != 0)
+	{
+		std::cout << "Could not write photon map to " << file_path << "." << std::endl;
+		remove(temporary_file_path.c_str());
+		return false;
+	}
+	std::cout << "Photon map saved to " << file_path << "." << std::endl;
+	return true;
+}
+
+bool Scene::loadPhotonMap(const char* file_path, const int n_photons)
+{
+	std::ifstream file(file_path, std::ios::binary);
+	if (!file)
+		return false;
+	if (!readPhotonMap(file, n_photons))
+	{
+		std::cout << "Could not load photon map from " << file_path << "." << std::endl;
+		return false;
+	}
+	std::cout << "Photon map loaded from " << file_path << "." << std::endl;
+	return true;
 }
 
 int Scene::getNumberOfTriangles()
@@ -595,8 +1316,72 @@ int Scene::getNumberOfSpheres()
 	return  n_spheres;
 }
 
-int Scene::getNumberOfPhotons()
+int Scene::getNumberOfCausticPhotons()
+{
+	return caustic_map_.size();
+}
+
+int Scene::getNumberOfIrradiancePhotons()
+{
+	return irradiance_map_.size();
+}
+
+void Scene::setPathDepth(int min_depth, int max_depth)
+{
+	min_path_depth_ = min_depth;
+	max_path_depth_ = max_depth;
+}
+
+void Scene::setFirstBounceSplitting(int n_splits)
+{
+	first_bounce_splits_ = glm::max(n_splits, 1);
+}
+
+void Scene::setDiffuseRenderMode(int render_mode)
 {
-	return photon_map_.size();
+	diffuse_render_mode_ = render_mode;
 }
 
+void Scene::setStochasticFresnel(bool stochastic)
+{
+	stochastic_fresnel_ = stochastic;
+}
+
+Scene::RayCounters& Scene::getRayCounters()
+{
+	return ray_counters_[ThreadPool::getThreadIndex() % N_RAY_COUNTERS_];
+}
+
+void Scene::resetRayStatistics()
+{
+	for (int i = 0; i < N_RAY_COUNTERS_; ++i)
+	{
+		ray_counters_[i].paths = 0;
+		ray_counters_[i].rays = 0;
+		ray_counters_[i].vertices = 0;
+	}
+}
+
+unsigned long long Scene::getNumberOfPaths()
+{
+	unsigned long long n = 0;
+	for (int i = 0; i < N_RAY_COUNTERS_; ++i)
+		n += ray_counters_[i].paths;
+	return n;
+}
+
+double Scene::getAveragePathLength()
+{
+	unsigned long long n = 0;
+	for (int i = 0; i < N_RAY_COUNTERS_; ++i)
+		n += ray_counters_[i].vertices;
+	return getNumberOfPaths() ? double(n) / getNumberOfPaths() : 0;
+}
+
+double Scene::getRaysPerSample()
+{
+	unsigned long long n = 0;
+	for (int i = 0; i < N_RAY_COUNTERS_; ++i)
+		n += ray_counters_[i].rays;
+	return getNumberOfPaths() ? double(n) / getNumberOfPaths() : 0;
+}
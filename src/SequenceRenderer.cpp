@@ -0,0 +1,212 @@
+#include "../include/SequenceRenderer.h"
+#include "../include/ImageIO.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+
+namespace
+{
+	// Same as the normal render
+	const float GAMMA = 1 / 2.2;
+
+	glm::vec3 catmullRom(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, glm::vec3 p3, float t)
+	{
+		return 0.5f * (2.0f * p1 + (p2 - p0) * t +
+			(2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t * t +
+			(3.0f * p1 - p0 - 3.0f * p2 + p3) * t * t * t);
+	}
+}
+
+bool SequenceRenderer::loadKeyframes(const char* file_path, std::vector<Keyframe>* keyframes)
+{
+	std::ifstream file(file_path);
+	if (!file)
+	{
+		std::cout << "Could not open " << file_path << std::endl;
+		return false;
+	}
+	keyframes->clear();
+	std::string line;
+	for (int line_number = 1; std::getline(file, line); ++line_number)
+	{
+		std::istringstream is(line);
+		std::string first;
+		if (!(is >> first) || first[0] == '#')
+			continue;
+		is.clear();
+		is.str(line);
+		Keyframe keyframe;
+		float fov_degrees = 60;
+		keyframe.up = glm::vec3(0, 1, 0);
+		if (!(is >> keyframe.frame >>
+			keyframe.eye.x >> keyframe.eye.y >> keyframe.eye.z >>
+			keyframe.center.x >> keyframe.center.y >> keyframe.center.z))
+		{
+			std::cout << file_path << ":" << line_number << ": expected frame, eye and center" << std::endl;
+			return false;
+		}
+		if (is >> fov_degrees)
+			is >> keyframe.up.x >> keyframe.up.y >> keyframe.up.z;
+		keyframe.fov = glm::radians(fov_degrees);
+		if (!keyframes->empty() && keyframe.frame <= keyframes->back().frame)
+		{
+			std::cout << file_path << ":" << line_number << ": frame numbers must increase" << std::endl;
+			return false;
+		}
+		keyframes->push_back(keyframe);
+	}
+	if (keyframes->empty())
+	{
+		std::cout << "No keyframes in " << file_path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+SequenceRenderer::SequenceRenderer(
+	Scene* scene,
+	const RenderSettings& settings,
+	const std::vector<Keyframe>& keyframes,
+	int specular_samples,
+	int caustics_samples,
+	int diffuse_samples) :
+	scene_(scene),
+	settings_(settings),
+	keyframes_(keyframes),
+	SPECULAR_SAMPLES_(specular_samples),
+	CAUSTICS_SAMPLES_(caustics_samples),
+	DIFFUSE_SAMPLES_(diffuse_samples)
+{}
+
+int SequenceRenderer::getFirstFrame() const
+{
+	return keyframes_.front().frame;
+}
+
+int SequenceRenderer::getLastFrame() const
+{
+	return keyframes_.back().frame;
+}
+
+SequenceRenderer::Keyframe SequenceRenderer::getCamera(int frame) const
+{
+	int k = 0;
+	while (k + 1 < keyframes_.size() && keyframes_[k + 1].frame <= frame)
+		k++;
+	if (k + 1 == keyframes_.size())
+	{
+		Keyframe camera = keyframes_[k];
+		camera.frame = frame;
+		return camera;
+	}
+	// The spline passes through the keyframes, the ends are repeated
+	const Keyframe& k0 = keyframes_[glm::max(k - 1, 0)];
+	const Keyframe& k1 = keyframes_[k];
+	const Keyframe& k2 = keyframes_[k + 1];
+	const Keyframe& k3 = keyframes_[glm::min(k + 2, int(keyframes_.size()) - 1)];
+	float t = float(frame - k1.frame) / (k2.frame - k1.frame);
+	Keyframe camera;
+	camera.frame = frame;
+	camera.eye = catmullRom(k0.eye, k1.eye, k2.eye, k3.eye, t);
+	camera.center = catmullRom(k0.center, k1.center, k2.center, k3.center, t);
+	camera.up = glm::normalize(glm::mix(k1.up, k2.up, t));
+	camera.fov = glm::mix(k1.fov, k2.fov, t);
+	return camera;
+}
+
+SequenceRenderer::Frame* SequenceRenderer::prepareFrame(int frame) const
+{
+	Keyframe camera = getCamera(frame);
+	Frame* f = new Frame;
+	f->number = frame;
+	f->camera = new Camera(
+		camera.eye,
+		camera.center,
+		camera.up,
+		camera.fov,
+		settings_.width,
+		settings_.height);
+	f->composite = new CompositeRenderer(
+		scene_,
+		f->camera,
+		settings_,
+		SPECULAR_SAMPLES_,
+		CAUSTICS_SAMPLES_,
+		DIFFUSE_SAMPLES_);
+	return f;
+}
+
+void SequenceRenderer::renderFrame(Frame* frame) const
+{
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point start = Clock::now();
+	CompositeRenderer* composite = frame->composite;
+	// The renderer was set up while the previous frame rendered, the time
+	// limit counts from the start of this frame
+	composite->setStartTime(start);
+	while (composite->renderPass())
+		;
+	double render_time = std::chrono::duration<double>(Clock::now() - start).count();
+	std::cout << "Frame " << frame->number << " of " << getLastFrame() << " rendered, " <<
+		composite->getNumberOfSamples() << " samples per pixel, " <<
+		render_time << " s." << std::endl;
+}
+
+void SequenceRenderer::deleteFrame(Frame* frame)
+{
+	if (!frame)
+		return;
+	delete frame->composite;
+	delete frame->camera;
+	delete frame;
+}
+
+bool SequenceRenderer::render(const std::string& output_prefix)
+{
+	bool success = true;
+	Frame* previous = NULL;
+	Frame* current = prepareFrame(getFirstFrame());
+	std::thread writer;
+	while (current)
+	{
+		// The next frame is set up while this one renders. Clearing its
+		// buffers runs on the thread pool between the passes.
+		Frame* next = NULL;
+		int next_number = current->number + 1;
+		std::thread setup;
+		if (next_number <= getLastFrame())
+			setup = std::thread([this, &next, next_number]() { next = prepareFrame(next_number); });
+
+		renderFrame(current);
+
+		// The previous frame is written by now, this one is written while
+		// the next one renders
+		if (writer.joinable())
+			writer.join();
+		deleteFrame(previous);
+		previous = current;
+		writer = std::thread([&success, previous, output_prefix]()
+		{
+			char number[16];
+			snprintf(number, sizeof(number), "%04d", previous->number);
+			std::string file_name = output_prefix + number + ".ppm";
+			const AccumulationBuffer& image = previous->composite->getAccumulationBuffer();
+			if (!image_io::saveEstimate(file_name.c_str(), image, GAMMA))
+			{
+				std::cout << "Could not write " << file_name << std::endl;
+				success = false;
+			}
+		});
+
+		if (setup.joinable())
+			setup.join();
+		current = next;
+	}
+	writer.join();
+	deleteFrame(previous);
+	return success;
+}
@@ -0,0 +1,238 @@
+#include "../include/Socket.h"
+
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <sys/un.h>
+
+namespace socket_io
+{
+	int listenTcp(int port)
+	{
+		int s = socket(AF_INET, SOCK_STREAM, 0);
+		if (s < 0)
+		{
+			std::cout << "Could not create socket: " << strerror(errno) << std::endl;
+			return -1;
+		}
+		int reuse = 1;
+		setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+		sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_ANY);
+		address.sin_port = htons(port);
+		if (bind(s, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+			listen(s, 64) < 0)
+		{
+			std::cout << "Could not listen on port " << port << ": " << strerror(errno) << std::endl;
+			close(s);
+			return -1;
+		}
+		return s;
+	}
+
+	int getPort(int socket)
+	{
+		sockaddr_in address;
+		socklen_t length = sizeof(address);
+		if (getsockname(socket, reinterpret_cast<sockaddr*>(&address), &length) < 0)
+			return -1;
+		return ntohs(address.sin_port);
+	}
+
+	int connectTcp(const std::string& host, int port)
+	{
+		addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		addrinfo* addresses;
+		std::string service = std::to_string(port);
+		if (getaddrinfo(host.c_str(), service.c_str(), &hints, &addresses) != 0)
+		{
+			std::cout << "Unknown host " << host << std::endl;
+			return -1;
+		}
+		int s = -1;
+		for (addrinfo* a = addresses; a && s < 0; a = a->ai_next)
+		{
+			s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+			if (s >= 0 && connect(s, a->ai_addr, a->ai_addrlen) < 0)
+			{
+				close(s);
+				s = -1;
+			}
+		}
+		freeaddrinfo(addresses);
+		if (s < 0)
+			std::cout << "Could not connect to " << host << ":" << port << std::endl;
+		return s;
+	}
+
+	int listenUnix(const std::string& file_path)
+	{
+		sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (file_path.size() >= sizeof(address.sun_path))
+		{
+			std::cout << "Socket path too long: " << file_path << std::endl;
+			return -1;
+		}
+		strcpy(address.sun_path, file_path.c_str());
+		int s = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (s < 0)
+		{
+			std::cout << "Could not create socket: " << strerror(errno) << std::endl;
+			return -1;
+		}
+		unlink(file_path.c_str());
+		if (bind(s, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+			listen(s, 64) < 0)
+		{
+			std::cout << "Could not listen on " << file_path << ": " << strerror(errno) << std::endl;
+			close(s);
+			return -1;
+		}
+		return s;
+	}
+
+	int connectUnix(const std::string& file_path)
+	{
+		sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		strncpy(address.sun_path, file_path.c_str(), sizeof(address.sun_path) - 1);
+		int s = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (s >= 0 && connect(s, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0)
+		{
+			close(s);
+			s = -1;
+		}
+		if (s < 0)
+			std::cout << "Could not connect to " << file_path << std::endl;
+		return s;
+	}
+
+	bool parseAddress(const std::string& address, std::string* host, int* port)
+	{
+		size_t colon = address.rfind(':');
+		if (colon == std::string::npos || colon + 1 == address.size())
+			return false;
+		*host = address.substr(0, colon);
+		*port = atoi(address.c_str() + colon + 1);
+		return *port > 0;
+	}
+
+	int acceptConnection(int listening_socket, int timeout_ms)
+	{
+		pollfd p = {listening_socket, POLLIN, 0};
+		if (poll(&p, 1, timeout_ms) <= 0)
+			return -1;
+		return accept(listening_socket, NULL, NULL);
+	}
+
+	void closeSocket(int socket)
+	{
+		close(socket);
+	}
+
+	void shutdownSocket(int socket)
+	{
+		shutdown(socket, SHUT_RDWR);
+	}
+
+	bool setReceiveTimeout(int socket, int timeout_ms)
+	{
+		timeval timeout;
+		timeout.tv_sec = timeout_ms / 1000;
+		timeout.tv_usec = (timeout_ms % 1000) * 1000;
+		return !setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	}
+
+	bool sendAll(int socket, const void* data, size_t size)
+	{
+		const char* bytes = static_cast<const char*>(data);
+		while (size)
+		{
+			// No SIGPIPE if the other end is gone, the error is returned
+			ssize_t n = send(socket, bytes, size, MSG_NOSIGNAL);
+			if (n <= 0)
+			{
+				if (n < 0 && errno == EINTR)
+					continue;
+				return false;
+			}
+			bytes += n;
+			size -= n;
+		}
+		return true;
+	}
+
+	bool receiveAll(int socket, void* data, size_t size)
+	{
+		char* bytes = static_cast<char*>(data);
+		while (size)
+		{
+			ssize_t n = recv(socket, bytes, size, 0);
+			if (n <= 0)
+			{
+				if (n < 0 && errno == EINTR)
+					continue;
+				return false;
+			}
+			bytes += n;
+			size -= n;
+		}
+		return true;
+	}
+
+	bool sendMessage(int socket, const std::string& message)
+	{
+		unsigned long long size = message.size();
+		return sendAll(socket, &size, sizeof(size)) &&
+			sendAll(socket, message.data(), message.size());
+	}
+
+	bool receiveMessage(int socket, std::string* message, size_t max_size)
+	{
+		unsigned long long size;
+		if (!receiveAll(socket, &size, sizeof(size)) || size > max_size)
+			return false;
+		message->resize(size);
+		return !size || receiveAll(socket, &(*message)[0], size);
+	}
+
+	bool sendLine(int socket, const std::string& line)
+	{
+		std::string data = line + '\n';
+		return sendAll(socket, data.data(), data.size());
+	}
+
+	bool receiveLine(int socket, std::string* line)
+	{
+		// Commands are short, reading a byte at a time leaves the rest of the
+		// stream in the socket
+		static const size_t MAX_LENGTH = 1 << 16;
+		line->clear();
+		char c;
+		while (receiveAll(socket, &c, 1))
+		{
+			if (c == '\n')
+				return true;
+			if (c != '\r')
+				line->push_back(c);
+			if (line->size() > MAX_LENGTH)
+				return false;
+		}
+		return false;
+	}
+}
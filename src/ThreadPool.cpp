@@ -0,0 +1,183 @@
+#include "../include/ThreadPool.h"
+
+#include <iostream>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+
+#include <omp.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+	std::unique_ptr<ThreadPool> pool;
+	std::mutex pool_mutex;
+	thread_local int thread_index = 0;
+	thread_local bool in_task = false;
+}
+
+ThreadPool& ThreadPool::instance()
+{
+	std::lock_guard<std::mutex> lock(pool_mutex);
+	if (!pool)
+		pool.reset(new ThreadPool(omp_get_max_threads(), false));
+	return *pool;
+}
+
+void ThreadPool::initialize(int n_threads, bool pin_threads)
+{
+	std::lock_guard<std::mutex> lock(pool_mutex);
+	pool.reset();
+	pool.reset(new ThreadPool(n_threads > 0 ? n_threads : omp_get_max_threads(), pin_threads));
+}
+
+int ThreadPool::getThreadIndex()
+{
+	return thread_index;
+}
+
+ThreadPool::ThreadPool(int n_threads, bool pin_threads) :
+	N_THREADS_(std::max(n_threads, 1)),
+	PIN_THREADS_(pin_threads),
+	task_(NULL),
+	generation_(0),
+	n_running_(0),
+	stop_(false)
+{
+	if (PIN_THREADS_)
+	{
+#ifdef __linux__
+		cpu_set_t allowed;
+		CPU_ZERO(&allowed);
+		sched_getaffinity(0, sizeof(allowed), &allowed);
+		for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+		{
+			if (CPU_ISSET(cpu, &allowed))
+				cpus_.push_back(cpu);
+		}
+#endif
+		if (cpus_.empty())
+			std::cout << "Could not find the CPUs to pin threads to." << std::endl;
+		pinThread(0);
+	}
+	for (int i = 1; i < N_THREADS_; ++i)
+		workers_.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	task_started_.notify_all();
+	for (int i = 0; i < workers_.size(); ++i)
+		workers_[i].join();
+}
+
+void ThreadPool::pinThread(int thread)
+{
+#ifdef __linux__
+	if (cpus_.empty())
+		return;
+	// Consecutive threads on consecutive CPUs, which usually share a socket
+	cpu_set_t cpu_set;
+	CPU_ZERO(&cpu_set);
+	CPU_SET(cpus_[thread % cpus_.size()], &cpu_set);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+#endif
+}
+
+void ThreadPool::workerLoop(int thread)
+{
+	thread_index = thread;
+	if (PIN_THREADS_)
+		pinThread(thread);
+	unsigned long long generation = 0;
+	while (true)
+	{
+		const std::function<void(int)>* task;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			task_started_.wait(lock, [&]{ return stop_ || generation_ != generation; });
+			if (stop_)
+				return;
+			generation = generation_;
+			task = task_;
+		}
+		in_task = true;
+		(*task)(thread);
+		in_task = false;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			n_running_--;
+		}
+		task_finished_.notify_one();
+	}
+}
+
+int ThreadPool::getNumberOfThreads() const
+{
+	return N_THREADS_;
+}
+
+bool ThreadPool::isPinned() const
+{
+	return PIN_THREADS_ && !cpus_.empty();
+}
+
+void ThreadPool::run(const std::function<void(int)>& task)
+{
+	if (in_task)
+	{ // Nested, the other threads are busy with the outer task
+		for (int i = 0; i < N_THREADS_; ++i)
+			task(i);
+		return;
+	}
+
+	std::lock_guard<std::mutex> run_lock(run_mutex_);
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		task_ = &task;
+		n_running_ = workers_.size();
+		generation_++;
+	}
+	task_started_.notify_all();
+
+	int outer_thread_index = thread_index;
+	thread_index = 0;
+	in_task = true;
+	task(0);
+	in_task = false;
+	thread_index = outer_thread_index;
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	task_finished_.wait(lock, [&]{ return n_running_ == 0; });
+	task_ = NULL;
+}
+
+void ThreadPool::parallelFor(
+	int begin,
+	int end,
+	int chunk_size,
+	const std::function<void(int, int)>& body)
+{
+	chunk_size = std::max(chunk_size, 1);
+	std::atomic<int> next(begin);
+	run([&](int thread)
+	{
+		while (true)
+		{
+			int chunk_begin = next.fetch_add(chunk_size);
+			if (chunk_begin >= end)
+				break;
+			int chunk_end = std::min(chunk_begin + chunk_size, end);
+			for (int i = chunk_begin; i < chunk_end; ++i)
+				body(i, thread);
+		}
+	});
+}
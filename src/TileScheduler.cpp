@@ -0,0 +1,219 @@
+#include "../include/TileScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#include "../include/ThreadPool.h"
+
+namespace
+{
+	// Position of index d along a Hilbert curve filling an n x n grid, n a
+	// power of two
+	void hilbertIndexToXY(int n, int d, int* x, int* y)
+	{
+		*x = 0;
+		*y = 0;
+		for (int s = 1; s < n; s *= 2)
+		{
+			int rx = 1 & (d / 2);
+			int ry = 1 & (d ^ rx);
+			if (ry == 0)
+			{ // Rotate the quadrant
+				if (rx == 1)
+				{
+					*x = s - 1 - *x;
+					*y = s - 1 - *y;
+				}
+				std::swap(*x, *y);
+			}
+			*x += s * rx;
+			*y += s * ry;
+			d /= 4;
+		}
+	}
+}
+
+const char* TileScheduler::getOrderName(int order)
+{
+	switch (order)
+	{
+		case SCANLINE : return "scanline";
+		case HILBERT : return "hilbert";
+		case SPIRAL : return "spiral";
+		default : return "unknown";
+	}
+}
+
+TileScheduler::TileScheduler(int width, int height, int tile_size, int order) :
+	queues_(ThreadPool::instance().getNumberOfThreads())
+{
+	tile_size = glm::max(tile_size, 1);
+	int n_tiles_x = (width + tile_size - 1) / tile_size;
+	int n_tiles_y = (height + tile_size - 1) / tile_size;
+	buildOrder(n_tiles_x, n_tiles_y, order);
+	for (int i = 0; i < tiles_.size(); ++i)
+	{
+		tiles_[i].x0 *= tile_size;
+		tiles_[i].y0 *= tile_size;
+		tiles_[i].x1 = glm::min(tiles_[i].x0 + tile_size, width);
+		tiles_[i].y1 = glm::min(tiles_[i].y0 + tile_size, height);
+	}
+	for (int i = 0; i < queues_.size(); ++i)
+	{
+		queues_[i].busy_time = 0;
+		queues_[i].n_rendered = 0;
+		queues_[i].n_stolen = 0;
+	}
+}
+
+void TileScheduler::buildOrder(int n_tiles_x, int n_tiles_y, int order)
+{
+	// Tiles are kept in tile coordinates until the constructor scales them
+	Tile tile = {0, 0, 0, 0};
+	switch (order)
+	{
+		case HILBERT :
+		{
+			int n = 1;
+			while (n < n_tiles_x || n < n_tiles_y)
+				n *= 2;
+			for (int d = 0; d < n * n; ++d)
+			{
+				hilbertIndexToXY(n, d, &tile.x0, &tile.y0);
+				if (tile.x0 < n_tiles_x && tile.y0 < n_tiles_y)
+					tiles_.push_back(tile);
+			}
+			break;
+		}
+		case SPIRAL :
+		{
+			// Rings of tiles around the center, each ring in angle order
+			std::vector<std::pair<std::pair<float, float>, Tile> > sorted;
+			float center_x = (n_tiles_x - 1) / 2.0f;
+			float center_y = (n_tiles_y - 1) / 2.0f;
+			for (tile.y0 = 0; tile.y0 < n_tiles_y; ++tile.y0)
+			{
+				for (tile.x0 = 0; tile.x0 < n_tiles_x; ++tile.x0)
+				{
+					float dx = tile.x0 - center_x;
+					float dy = tile.y0 - center_y;
+					float ring = glm::max(std::abs(dx), std::abs(dy));
+					sorted.push_back(std::make_pair(std::make_pair(ring, atan2(dy, dx)), tile));
+				}
+			}
+			std::stable_sort(sorted.begin(), sorted.end(),
+				[](const std::pair<std::pair<float, float>, Tile>& a,
+					const std::pair<std::pair<float, float>, Tile>& b)
+				{ return a.first < b.first; });
+			for (int i = 0; i < sorted.size(); ++i)
+				tiles_.push_back(sorted[i].second);
+			break;
+		}
+		default :
+		{
+			for (tile.y0 = 0; tile.y0 < n_tiles_y; ++tile.y0)
+			{
+				for (tile.x0 = 0; tile.x0 < n_tiles_x; ++tile.x0)
+					tiles_.push_back(tile);
+			}
+			break;
+		}
+	}
+}
+
+bool TileScheduler::nextTile(int thread, bool steal, int* tile_index)
+{
+	Queue& own = queues_[thread];
+	{
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (own.begin < own.end)
+		{
+			*tile_index = own.begin++;
+			return true;
+		}
+	}
+	if (!steal)
+		return false;
+	// Steal the last tile of the thread with most tiles left. The counts are
+	// read without locking, the victim is checked again under its lock.
+	while (true)
+	{
+		int victim = -1;
+		int most_left = 0;
+		for (int i = 0; i < queues_.size(); ++i)
+		{
+			int left = queues_[i].end - queues_[i].begin;
+			if (left > most_left)
+			{
+				most_left = left;
+				victim = i;
+			}
+		}
+		if (victim < 0)
+			return false;
+		std::lock_guard<std::mutex> lock(queues_[victim].mutex);
+		if (queues_[victim].begin < queues_[victim].end)
+		{
+			*tile_index = --queues_[victim].end;
+			own.n_stolen++;
+			return true;
+		}
+	}
+}
+
+void TileScheduler::run(
+	const std::function<void(const Tile&, int)>& render_tile,
+	bool steal)
+{
+	typedef std::chrono::steady_clock Clock;
+	int n_threads = queues_.size();
+	for (int i = 0; i < n_threads; ++i)
+	{
+		queues_[i].begin = long(tiles_.size()) * i / n_threads;
+		queues_[i].end = long(tiles_.size()) * (i + 1) / n_threads;
+		queues_[i].busy_time = 0;
+		queues_[i].n_rendered = 0;
+		queues_[i].n_stolen = 0;
+	}
+
+	ThreadPool::instance().run([&](int thread)
+	{
+		int tile_index;
+		while (nextTile(thread, steal, &tile_index))
+		{
+			Clock::time_point start = Clock::now();
+			render_tile(tiles_[tile_index], thread);
+			queues_[thread].busy_time +=
+				std::chrono::duration<double>(Clock::now() - start).count();
+			queues_[thread].n_rendered++;
+		}
+	});
+}
+
+int TileScheduler::getNumberOfTiles() const
+{
+	return tiles_.size();
+}
+
+int TileScheduler::getNumberOfThreads() const
+{
+	return queues_.size();
+}
+
+double TileScheduler::getBusyTime(int thread) const
+{
+	return queues_[thread].busy_time;
+}
+
+int TileScheduler::getNumberOfRenderedTiles(int thread) const
+{
+	return queues_[thread].n_rendered;
+}
+
+int TileScheduler::getNumberOfStolenTiles(int thread) const
+{
+	return queues_[thread].n_stolen;
+}
@@ -0,0 +1,39 @@
+#include "../include/Warp.h"
+
+namespace warp
+{
+	glm::vec3 squareToUniformSphere(glm::vec2 sample)
+	{
+		float z = 1 - 2 * sample.x;
+		float r = std::sqrt(glm::max(0.0f, 1 - z * z));
+		float phi = 2 * M_PI * sample.y;
+		return glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+	}
+
+	void cosineHemisphere(
+		glm::vec3 normal,
+		const float* u,
+		const float* v,
+		int n,
+		float* x,
+		float* y,
+		float* z)
+	{
+		glm::vec3 t, b;
+		buildOrthonormalBasis(normal, &t, &b);
+		// Plain locals, the loop is not vectorized when it reads the
+		// components of the vectors
+		const float tx = t.x, ty = t.y, tz = t.z;
+		const float bx = b.x, by = b.y, bz = b.z;
+		const float nx = normal.x, ny = normal.y, nz = normal.z;
+		#pragma omp simd
+		for (int i = 0; i < n; ++i)
+		{
+			float dx, dy, dz;
+			squareToCosineHemisphere(u[i], v[i], &dx, &dy, &dz);
+			x[i] = dx * tx + dy * bx + dz * nx;
+			y[i] = dx * ty + dy * by + dz * ny;
+			z[i] = dx * tz + dy * bz + dz * nz;
+		}
+	}
+}
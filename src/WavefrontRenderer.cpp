@@ -0,0 +1,302 @@
+#include "../include/WavefrontRenderer.h"
+
+#include <chrono>
+
+#include "../include/ThreadPool.h"
+
+// Paths are handed out to the threads in chunks of this size
+static const int CHUNK_SIZE = 64;
+
+struct WavefrontRenderer::VertexSink : public Scene::PathVertexSink
+{
+	VertexSink(const Path& path, ThreadQueues* out) :
+		path(path), out(out), n_branches(0) {};
+	void addRadiance(const SpectralDistribution& radiance)
+	{
+		Contribution contribution = {path.pixel, radiance * path.weight};
+		out->contributions.push_back(contribution);
+	}
+	void addBranch(const Ray& r, int render_mode, int iteration)
+	{
+		Path branch = path;
+		branch.ray = r;
+		branch.render_mode = render_mode;
+		branch.iteration = iteration;
+		branch.dimension = getBranchDimension(path.dimension, n_branches++);
+		out->paths.push_back(branch);
+	}
+	void addShadowRay(
+		const Scene::ShadowRay& shadow_ray,
+		glm::vec3 direction_out,
+		const IntersectionData& id,
+		const SpectralDistribution& throughput)
+	{
+		PendingShadowRay pending = {
+			shadow_ray, direction_out, id, throughput * path.weight, path.pixel};
+		out->shadow_rays.push_back(pending);
+	}
+
+	const Path& path;
+	ThreadQueues* out;
+	int n_branches;
+};
+
+const char* WavefrontRenderer::getStageName(int stage)
+{
+	switch (stage)
+	{
+		case GENERATE : return "generate";
+		case INTERSECT : return "intersect";
+		case SORT : return "sort";
+		case SHADE : return "shade";
+		case SHADOW : return "shadow rays";
+		case ACCUMULATE : return "accumulate";
+		default : return "unknown";
+	}
+}
+
+WavefrontRenderer::WavefrontRenderer(
+	Scene* scene,
+	Camera* camera,
+	int sampler_type,
+	unsigned int seed,
+	int batch_size) :
+	scene_(scene),
+	camera_(camera),
+	SAMPLER_TYPE_(sampler_type),
+	SEED_(seed),
+	BATCH_SIZE_(glm::max(batch_size, 1)),
+	queues_(ThreadPool::instance().getNumberOfThreads()),
+	image_(camera->WIDTH * camera->HEIGHT),
+	n_batches_(0)
+{
+	for (int i = 0; i < queues_.size(); ++i)
+		samplers_.push_back(Sampler::create(sampler_type, seed));
+	for (int i = 0; i < N_STAGES; ++i)
+		stage_times_[i] = 0;
+}
+
+WavefrontRenderer::~WavefrontRenderer()
+{
+	for (int i = 0; i < samplers_.size(); ++i)
+		delete samplers_[i];
+}
+
+unsigned int WavefrontRenderer::getBranchDimension(unsigned int dimension, int k)
+{
+	unsigned int h = dimension * 0x9e3779b9u + k + 1;
+	h ^= h >> 16;
+	h *= 0x7feb352du;
+	h ^= h >> 15;
+	h *= 0x846ca68bu;
+	h ^= h >> 16;
+	// Never the first block, it belongs to the camera ray
+	return (h % (0xffffffffu / BRANCH_DIMENSIONS - 1) + 1) * BRANCH_DIMENSIONS;
+}
+
+void WavefrontRenderer::render(
+	int render_mode,
+	int first_sample,
+	int end_sample,
+	int n_samples,
+	const std::function<void(Ray*, int)>& prepare_ray)
+{
+	typedef std::chrono::steady_clock Clock;
+	for (int i = 0; i < image_.size(); ++i)
+		image_[i] = SpectralDistribution();
+	for (int i = 0; i < N_STAGES; ++i)
+		stage_times_[i] = 0;
+	n_batches_ = 0;
+
+	Clock::time_point start = Clock::now();
+	// Adds the time since the last call to stage
+	auto lap = [&](int stage)
+	{
+		Clock::time_point now = Clock::now();
+		stage_times_[stage] += std::chrono::duration<double>(now - start).count();
+		start = now;
+	};
+
+	// Sample major, so a batch covers neighbouring pixels
+	long n_paths_total = long(image_.size()) * glm::max(end_sample - first_sample, 0);
+	for (long first = 0; first < n_paths_total; first += BATCH_SIZE_)
+	{
+		generate(first, glm::min(long(BATCH_SIZE_), n_paths_total - first),
+			first_sample, n_samples, render_mode, prepare_ray);
+		lap(GENERATE);
+		while (!paths_.empty())
+		{
+			n_batches_++;
+			intersect();
+			lap(INTERSECT);
+			sort();
+			lap(SORT);
+			shade(n_samples);
+			lap(SHADE);
+			traceShadowRays();
+			lap(SHADOW);
+			accumulate();
+			lap(ACCUMULATE);
+		}
+	}
+}
+
+SpectralDistribution WavefrontRenderer::getRadianceSum(int index) const
+{
+	return image_[index];
+}
+
+double WavefrontRenderer::getStageTime(int stage) const
+{
+	return stage_times_[stage];
+}
+
+int WavefrontRenderer::getNumberOfBatches() const
+{
+	return n_batches_;
+}
+
+void WavefrontRenderer::generate(
+	long first_path,
+	long n_paths,
+	int first_sample,
+	int n_samples,
+	int render_mode,
+	const std::function<void(Ray*, int)>& prepare_ray)
+{
+	paths_.resize(n_paths);
+	glm::vec3 camera_plane_normal = glm::normalize(camera_->center - camera_->eye);
+	ThreadPool::instance().parallelFor(0, n_paths, CHUNK_SIZE, [&](int i, int thread)
+	{
+		long path_index = first_path + i;
+		Path& path = paths_[i];
+		path.pixel = path_index % image_.size();
+		path.sample = first_sample + path_index / image_.size();
+		int x = path.pixel % camera_->WIDTH;
+		int y = path.pixel / camera_->WIDTH;
+
+		Sampler* sampler = samplers_[thread];
+		sampler->startSample(path.pixel, path.sample, n_samples);
+		glm::vec2 jitter = sampler->next2D() - 0.5f;
+		path.ray = camera_->castRay(x, (camera_->HEIGHT - y - 1), jitter.x, jitter.y);
+		if (prepare_ray)
+			prepare_ray(&path.ray, path.sample);
+		path.weight = glm::dot(path.ray.direction, camera_plane_normal);
+		path.dimension = sampler->getDimension();
+		path.render_mode = render_mode;
+		path.iteration = 0;
+		scene_->getRayCounters().paths++;
+	});
+}
+
+void WavefrontRenderer::intersect()
+{
+	hits_.resize(paths_.size());
+	ThreadPool::instance().parallelFor(0, paths_.size(), CHUNK_SIZE, [&](int i, int thread)
+	{
+		Scene::RayCounters& counters = scene_->getRayCounters();
+		Hit& hit = hits_[i];
+		counters.rays++;
+		if (scene_->intersectLamp(&hit.lamp_id, paths_[i].ray))
+		{
+			hit.kind = LAMP;
+			return;
+		}
+		if (!scene_->intersect(&hit.id, paths_[i].ray))
+		{
+			hit.kind = MISS;
+			return;
+		}
+		counters.vertices++;
+		const Material& material = hit.id.material;
+		if (material.transmissivity)
+			hit.kind = material.transmissivity < 1 ? MIXED : TRANSMISSIVE;
+		else if (material.specular_reflectance == 1)
+			hit.kind = SPECULAR;
+		else if (material.specular_reflectance == 0)
+			hit.kind = DIFFUSE;
+		else
+			hit.kind = MIXED;
+	});
+}
+
+void WavefrontRenderer::sort()
+{
+	// Counting sort, misses are dropped
+	int offsets[N_HIT_KINDS + 1] = {0};
+	for (int i = 0; i < hits_.size(); ++i)
+		offsets[hits_[i].kind + 1]++;
+	offsets[MISS + 1] = 0;
+	for (int kind = 0; kind < N_HIT_KINDS; ++kind)
+		offsets[kind + 1] += offsets[kind];
+	order_.resize(offsets[N_HIT_KINDS]);
+	for (int i = 0; i < hits_.size(); ++i)
+	{
+		if (hits_[i].kind != MISS)
+			order_[offsets[hits_[i].kind]++] = i;
+	}
+}
+
+void WavefrontRenderer::shade(int n_samples)
+{
+	ThreadPool::instance().parallelFor(0, order_.size(), CHUNK_SIZE, [&](int i, int thread)
+	{
+		const Path& path = paths_[order_[i]];
+		const Hit& hit = hits_[order_[i]];
+		ThreadQueues* out = &queues_[thread];
+		if (hit.kind == LAMP)
+		{
+			Contribution contribution = {path.pixel, path.ray.radiance * path.weight *
+				scene_->evaluateLampHit(path.ray, hit.lamp_id, path.render_mode)};
+			out->contributions.push_back(contribution);
+			return;
+		}
+		// Continue the random numbers where the path left them
+		Sampler* sampler = samplers_[thread];
+		sampler->startSample(path.pixel, path.sample, n_samples);
+		sampler->setDimension(path.dimension);
+		VertexSink sink(path, out);
+		scene_->shadeSurface(
+			path.ray, hit.id, path.render_mode, path.iteration, sampler, &sink);
+	});
+
+	// The new branches are the next batch
+	paths_.clear();
+	for (int i = 0; i < queues_.size(); ++i)
+	{
+		paths_.insert(paths_.end(), queues_[i].paths.begin(), queues_[i].paths.end());
+		queues_[i].paths.clear();
+	}
+}
+
+void WavefrontRenderer::traceShadowRays()
+{
+	for (int q = 0; q < queues_.size(); ++q)
+	{
+		const std::vector<PendingShadowRay>& shadow_rays = queues_[q].shadow_rays;
+		ThreadPool::instance().parallelFor(0, shadow_rays.size(), CHUNK_SIZE, [&](int i, int thread)
+		{
+			const PendingShadowRay& pending = shadow_rays[i];
+			LightSourceIntersectionData lamp_id;
+			if (!scene_->intersectLamp(&lamp_id, pending.shadow_ray.ray))
+				return;
+			Contribution contribution = {pending.pixel, pending.weight *
+				scene_->evaluateShadowRay(pending.direction_out, pending.id, pending.shadow_ray, lamp_id)};
+			queues_[thread].contributions.push_back(contribution);
+		});
+	}
+	for (int q = 0; q < queues_.size(); ++q)
+		queues_[q].shadow_rays.clear();
+}
+
+void WavefrontRenderer::accumulate()
+{
+	// Serial, contributions of different threads may go to the same pixel
+	for (int q = 0; q < queues_.size(); ++q)
+	{
+		std::vector<Contribution>& contributions = queues_[q].contributions;
+		for (int i = 0; i < contributions.size(); ++i)
+			image_[contributions[i].pixel] += contributions[i].radiance;
+		contributions.clear();
+	}
+}
@@ -3,24 +3,94 @@
 #include <cmath>
 #include <stdio.h>
 #include <time.h>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <new>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
 
 #include <glm/glm.hpp>
-#include <omp.h>
 
 #include "../include/Camera.h"
 #include "../include/Scene.h"
+#include "../include/ProgressivePhotonMapper.h"
+#include "../include/AdaptiveRenderer.h"
+#include "../include/RenderSettings.h"
+#include "../include/TileScheduler.h"
+#include "../include/ThreadPool.h"
+#include "../include/CompositeRenderer.h"
+#include "../include/RenderCoordinator.h"
+#include "../include/RenderWorker.h"
+#include "../include/RenderServer.h"
+#include "../include/SequenceRenderer.h"
+#include "../include/ImageIO.h"
 
-int savePPM(
-	const char* file_name,
-	const int width,
-	const int height,
-	unsigned char* data)
+// Set by SIGUSR1, the snapshot thread writes a snapshot when it sees it
+volatile sig_atomic_t snapshot_requested = 0;
+
+void requestSnapshot(int signal_number)
 {
-	FILE *fp = fopen(file_name, "wb"); // b - binary mode
-	fprintf(fp, "P6\n%d %d\n255\n", width, height);
-	fwrite(data, 1, width * height * 3, fp);
-	fclose(fp);
-	return EXIT_SUCCESS;
+	snapshot_requested = 1;
+}
+
+// Set by SIGTERM and SIGINT when checkpoints are saved. A second signal
+// terminates the process right away.
+volatile sig_atomic_t stop_requested = 0;
+
+void requestStop(int signal_number)
+{
+	stop_requested = 1;
+	signal(signal_number, SIG_DFL);
+}
+
+// Starts n_workers copies of this program as workers of the coordinator on
+// port. They get the same arguments without the coordinator options, and
+// write their output to worker_<i>.log.
+std::vector<pid_t> startLocalWorkers(int argc, char const *argv[], int n_workers, int port)
+{
+	std::vector<std::string> arguments;
+	for (int i = 0; i < argc; ++i)
+	{
+		std::string argument = argv[i];
+		if ((argument == "--coordinator" || argument == "--local-workers") && i + 1 < argc)
+			++i;
+		else
+			arguments.push_back(argument);
+	}
+	arguments.push_back("--worker");
+	arguments.push_back("127.0.0.1:" + std::to_string(port));
+	std::vector<char*> exec_arguments;
+	for (int i = 0; i < arguments.size(); ++i)
+		exec_arguments.push_back(&arguments[i][0]);
+	exec_arguments.push_back(NULL);
+
+	std::vector<pid_t> workers;
+	for (int i = 0; i < n_workers; ++i)
+	{
+		std::string log_file_name = "worker_" + std::to_string(i) + ".log";
+		pid_t pid = fork();
+		if (pid == 0)
+		{
+			int log_file = open(log_file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (log_file >= 0)
+			{
+				dup2(log_file, STDOUT_FILENO);
+				dup2(log_file, STDERR_FILENO);
+				close(log_file);
+			}
+			execv("/proc/self/exe", &exec_arguments[0]);
+			_exit(EXIT_FAILURE);
+		}
+		if (pid < 0)
+			std::cout << "Could not start worker " << i << std::endl;
+		else
+			workers.push_back(pid);
+	}
+	return workers;
 }
 
 // Get current date/time, format is YYYY-MM-DD.HH:mm:ss
@@ -38,13 +108,27 @@ int main(int argc, char const *argv[])
 {
 	time_t time_start, time_now, rendertime_start;
 	time(&time_start);
+	std::chrono::steady_clock::time_point program_start = std::chrono::steady_clock::now();
+
+	RenderSettings settings;
+	if (!parseRenderSettings(argc, argv, &settings))
+		return EXIT_FAILURE;
 
-	static const int WIDTH = 1024 / 1;
-	static const int HEIGHT = 768 / 1;
-	static const int SUB_SAMPLING_CAUSTICS = 10;
-	static const int SUB_SAMPLING_MONTE_CARLO = 500;
-	static const int SUB_SAMPLING_DIRECT_SPECULAR = 100;
-	static const int NUMBER_OF_PHOTONS_EMISSION = 2000000;
+	const int WIDTH = settings.width;
+	const int HEIGHT = settings.height;
+	// Progressive photon mapping replaces the caustics and Monte Carlo passes
+	// and does not need the photon map to be built up front
+	const bool PROGRESSIVE = settings.progressive_photon_mapping;
+	// Adaptive sampling replaces the uniform Monte Carlo pass
+	const bool ADAPTIVE = settings.adaptive_sampling && !PROGRESSIVE;
+	const int SUB_SAMPLING_CAUSTICS = PROGRESSIVE ? 0 : settings.sub_sampling_caustics;
+	const int SUB_SAMPLING_MONTE_CARLO =
+		PROGRESSIVE || ADAPTIVE ? 0 : settings.sub_sampling_monte_carlo;
+	const int SUB_SAMPLING_DIRECT_SPECULAR = settings.sub_sampling_direct_specular;
+	const int NUMBER_OF_PHOTONS_EMISSION = PROGRESSIVE ? 0 : settings.number_of_photons_emission;
+	// Scene::FINAL_GATHERING ends paths at the second diffuse surface by
+	// looking up the precomputed irradiance of the global photon map
+	static const int DIFFUSE_RENDER_MODE = Scene::MONTE_CARLO;
 
 	// The camera is used to cast appropriate initial rays
 	Camera c(
@@ -54,104 +138,365 @@ int main(int argc, char const *argv[])
 		M_PI / 3, // Field of view in radians
 		WIDTH, // pixel width
 		HEIGHT); // pixel height
-	glm::vec3 camera_plane_normal = glm::normalize(c.center - c.eye);
+
+	// All phases run on the threads of this pool
+	ThreadPool::initialize(settings.n_threads, settings.pin_threads);
+	ThreadPool& pool = ThreadPool::instance();
+	std::cout << "Threads : " << pool.getNumberOfThreads() <<
+		(pool.isPinned() ? ", pinned" : "") << std::endl;
 
 	// 3D objects are contained in the Scene object
-	Scene s(argv[1]);
+	Scene s(settings.scene_file_path);
+	s.setPathDepth(settings.min_path_depth, settings.max_path_depth);
+	s.setFirstBounceSplitting(settings.first_bounce_splits);
+	s.setStochasticFresnel(settings.stochastic_fresnel);
+	s.setDiffuseRenderMode(DIFFUSE_RENDER_MODE);
 
-	// irradiance_values will hold image data
-	SpectralDistribution* irradiance_values = new SpectralDistribution[c.WIDTH * c.HEIGHT];
+	CompositeRenderer composite(
+		&s,
+		&c,
+		settings,
+		SUB_SAMPLING_DIRECT_SPECULAR,
+		SUB_SAMPLING_CAUSTICS,
+		SUB_SAMPLING_MONTE_CARLO);
+	// The time limit counts from the start of the program
+	composite.setStartTime(program_start);
+	if (composite.getPassSamples() != settings.pass_samples)
+	{
+		std::cout << "Passes are rounded up to " << composite.getPassSamples() <<
+			" samples per pixel, whole periods of the sample budgets." << std::endl;
+	}
+	// A checkpoint has the samples so far and the photon maps
+	if (settings.resume)
+	{
+		if (!composite.loadCheckpoint(settings.checkpoint_file, NUMBER_OF_PHOTONS_EMISSION))
+			return EXIT_FAILURE;
+		std::cout << "Resuming from " << settings.checkpoint_file << " at " <<
+			composite.getNumberOfSamples() << " of " << composite.getTotalNumberOfSamples() <<
+			" samples per pixel." << std::endl;
+	}
+
+	// irradiance_values will hold image data. It is allocated untouched and
+	// the tiles are zeroed on the threads that are likely to use them, so
+	// most memory pages are placed on the NUMA node of their thread. Pages
+	// span rows of several tiles, those go to the node of one of them.
+	TileScheduler scheduler(c.WIDTH, c.HEIGHT, settings.tile_size, settings.tile_order);
+	SpectralDistribution* irradiance_values = static_cast<SpectralDistribution*>(
+		::operator new[](c.WIDTH * c.HEIGHT * sizeof(SpectralDistribution)));
+	scheduler.run([&](const TileScheduler::Tile& tile, int thread)
+	{
+		for (int y = tile.y0; y < tile.y1; ++y)
+		{
+			for (int x = tile.x0; x < tile.x1; ++x)
+				new (&irradiance_values[x + y * c.WIDTH]) SpectralDistribution();
+		}
+	}, false);
 	// irradiance_values need to be converted to rgb pixel data for displaying
 	unsigned char* pixel_values =
 		new unsigned char[c.WIDTH * c.HEIGHT * 3]; // w * h * rgb
 
-	std::random_device rd;
-	std::mt19937 gen(rd());
-	std::uniform_real_distribution<float> dis(-0.5, 0.5);
+	if (NUMBER_OF_PHOTONS_EMISSION && !settings.resume)
+	{
+		char photon_map_file_name[64];
+		snprintf(
+			photon_map_file_name,
+			sizeof(photon_map_file_name),
+			"photon_map_%016llx.bin",
+			s.getPhotonMapKey(NUMBER_OF_PHOTONS_EMISSION));
+		if (!settings.photon_map_cache ||
+			!s.loadPhotonMap(photon_map_file_name, NUMBER_OF_PHOTONS_EMISSION))
+		{
+			std::cout << "Building photon map." << std::endl;
+			s.buildPhotonMap(NUMBER_OF_PHOTONS_EMISSION);
+			if (settings.photon_map_cache)
+				s.savePhotonMap(photon_map_file_name, NUMBER_OF_PHOTONS_EMISSION);
+		}
+	}
+
+	// A server keeps the scene and photon maps loaded for the jobs of its
+	// clients
+	if (settings.server_socket)
+	{
+		RenderServer server(&s, settings);
+		bool success = server.listen(settings.server_socket);
+		if (success)
+		{
+			std::cout << "Render server listening on " << settings.server_socket << std::endl;
+			server.run();
+		}
+		::operator delete[](irradiance_values);
+		delete [] pixel_values;
+		return success ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	// All frames of a camera path share the scene and photon maps
+	if (settings.sequence_file)
+	{
+		std::vector<SequenceRenderer::Keyframe> keyframes;
+		bool success = SequenceRenderer::loadKeyframes(settings.sequence_file, &keyframes);
+		if (success)
+		{
+			SequenceRenderer sequence(
+				&s,
+				settings,
+				keyframes,
+				SUB_SAMPLING_DIRECT_SPECULAR,
+				SUB_SAMPLING_CAUSTICS,
+				SUB_SAMPLING_MONTE_CARLO);
+			success = sequence.render(settings.sequence_output);
+			time(&time_now);
+			int n_frames = sequence.getLastFrame() - sequence.getFirstFrame() + 1;
+			std::cout << "Rendered " << n_frames << " frames in " <<
+				difftime(time_now, time_start) << " s." << std::endl;
+		}
+		::operator delete[](irradiance_values);
+		delete [] pixel_values;
+		return success ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
 
-	std::cout << "Building photon map." << std::endl;
-	s.buildPhotonMap(NUMBER_OF_PHOTONS_EMISSION);
+	// A worker only renders jobs of the coordinator, which writes the image
+	if (settings.worker_address)
+	{
+		RenderWorker worker(
+			&composite,
+			s.getSceneKey(),
+			s.getPhotonMapKey(NUMBER_OF_PHOTONS_EMISSION));
+		bool success = worker.run(settings.worker_address);
+		std::cout << "Rendered " << worker.getNumberOfJobs() << " jobs." << std::endl;
+		::operator delete[](irradiance_values);
+		delete [] pixel_values;
+		return success ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
 
 	float rendering_percent_finished = 0;
 	std::cout << "Rendering started!" << std::endl;
 	std::cout << rendering_percent_finished << " \% finished." << std::endl;
 
 	time(&rendertime_start);
+	s.resetRayStatistics();
 
 	double prerender_time = difftime(rendertime_start, time_start);
 
-	// Loop through all pixels to calculate their irradiance_values by ray-tracing
-	for (int x = 0; x < c.WIDTH; ++x)
+	// Converted to rgb with this gamma correction
+	float gamma = 1 / 2.2;
+
+	// Writes snapshots of the accumulated image while the passes run
+	std::mutex snapshot_mutex;
+	std::condition_variable snapshot_condition;
+	bool rendering_done = false;
+	signal(SIGUSR1, requestSnapshot);
+	std::thread snapshot_thread([&]()
 	{
-		// Parallellize the for loop with openMP.
-		#pragma omp parallel for
-		for (int y = 0; y < c.HEIGHT; ++y)
+		typedef std::chrono::steady_clock Clock;
+		Clock::time_point last_snapshot = Clock::now();
+		std::unique_lock<std::mutex> lock(snapshot_mutex);
+		while (!rendering_done)
+		{
+			snapshot_condition.wait_for(lock, std::chrono::milliseconds(100));
+			bool interval_passed = settings.snapshot_interval > 0 &&
+				std::chrono::duration<double>(Clock::now() - last_snapshot).count() >=
+				settings.snapshot_interval;
+			if (rendering_done || !(snapshot_requested || interval_passed))
+				continue;
+			snapshot_requested = 0;
+			last_snapshot = Clock::now();
+			if (image_io::saveEstimate("snapshot.ppm", composite.getAccumulationBuffer(), gamma))
+				std::cout << "Snapshot written to snapshot.ppm" << std::endl;
+		}
+	});
+
+	// Asked to stop, the render stops after saving a checkpoint at the end
+	// of the pass
+	time_t last_checkpoint = time(0);
+	if (settings.checkpoint_interval > 0)
+	{
+		signal(SIGTERM, requestStop);
+		signal(SIGINT, requestStop);
+	}
+
+	// With a time limit or noise target passes are added until it is met
+	const bool BUDGETED = settings.time_limit > 0 || settings.target_noise > 0;
+	const bool COORDINATOR = settings.coordinator_port >= 0;
+	int n_workers = 0;
+	if (COORDINATOR)
+	{
+		// The workers render the passes as jobs, the coordinator only adds
+		// them up
+		RenderCoordinator coordinator(
+			&composite,
+			composite.getPassSamples(),
+			s.getSceneKey(),
+			s.getPhotonMapKey(NUMBER_OF_PHOTONS_EMISSION));
+		bool rendered = coordinator.listen(settings.coordinator_port);
+		if (rendered)
+		{
+			std::cout << "Coordinator listening on port " << coordinator.getPort() << std::endl;
+			std::vector<pid_t> local_workers =
+				startLocalWorkers(argc, argv, settings.local_workers, coordinator.getPort());
+			rendered = coordinator.run(local_workers);
+			n_workers = coordinator.getNumberOfWorkers();
+			std::cout << "Workers : " << n_workers << std::endl;
+		}
+		if (!rendered)
 		{
-			int index = (x + y * c.WIDTH);
-			SpectralDistribution sd;
-			if (SUB_SAMPLING_DIRECT_SPECULAR)
 			{
-				for (int i = 0; i < SUB_SAMPLING_DIRECT_SPECULAR; ++i)
-				{
-					Ray r = c.castRay(
-						x, // Pixel x
-						(c.HEIGHT - y - 1), // Pixel y 
-						dis(gen), // Parameter x (>= -0.5 and < 0.5), for subsampling
-						dis(gen)); // Parameter y (>= -0.5 and < 0.5), for subsampling
-					sd += s.traceRay(r, Scene::WHITTED_SPECULAR) * glm::dot(r.direction, camera_plane_normal);
-				}
-				irradiance_values[index] += sd / SUB_SAMPLING_DIRECT_SPECULAR * (2 * M_PI);				
-			}
-			sd = SpectralDistribution();
-			if (SUB_SAMPLING_CAUSTICS)
-				{
-				for (int i = 0; i < SUB_SAMPLING_CAUSTICS; ++i)
-				{
-					Ray r = c.castRay(
-						x, // Pixel x
-						(c.HEIGHT - y - 1), // Pixel y 
-						dis(gen), // Parameter x (>= -0.5 and < 0.5), for subsampling
-						dis(gen)); // Parameter y (>= -0.5 and < 0.5), for subsampling
-					sd += s.traceRay(r, Scene::CAUSTICS) * glm::dot(r.direction, camera_plane_normal);
-				}
-				irradiance_values[index] += sd / SUB_SAMPLING_CAUSTICS * (2 * M_PI);
-			}
-			sd = SpectralDistribution();
-			if (SUB_SAMPLING_MONTE_CARLO)
-				{
-				for (int i = 0; i < SUB_SAMPLING_MONTE_CARLO; ++i)
-				{
-					Ray r = c.castRay(
-						x, // Pixel x
-						(c.HEIGHT - y - 1), // Pixel y 
-						dis(gen), // Parameter x (>= -0.5 and < 0.5), for subsampling
-						dis(gen)); // Parameter y (>= -0.5 and < 0.5), for subsampling
-					sd += s.traceRay(r, Scene::MONTE_CARLO) * glm::dot(r.direction, camera_plane_normal);
-				}
-				irradiance_values[index] += sd / SUB_SAMPLING_MONTE_CARLO * (2 * M_PI);
+				std::lock_guard<std::mutex> lock(snapshot_mutex);
+				rendering_done = true;
 			}
+			snapshot_condition.notify_one();
+			snapshot_thread.join();
+			::operator delete[](irradiance_values);
+			delete [] pixel_values;
+			return EXIT_FAILURE;
 		}
-
-		// To show how much time we have left.
-		rendering_percent_finished = (x+1) * 100 / float(c.WIDTH);
-	  	time(&time_now);
+	}
+	// renderPass() stops when the budget is reached
+	while (!COORDINATOR && composite.renderPass())
+	{
+		time(&time_now);
 		double rendering_time_elapsed = difftime(time_now, rendertime_start);
-		double rendering_time_left = (rendering_time_elapsed / rendering_percent_finished) *
-			(100 - rendering_percent_finished);
+		if (BUDGETED)
+		{
+			std::cout << "Pass " << composite.getNumberOfPasses() << " finished, " <<
+				composite.getNumberOfSamples() << " samples per pixel";
+			if (settings.target_noise > 0)
+				std::cout << ", estimated relative error " << composite.getRelativeError();
+			std::cout << "." << std::endl;
+		}
+		else
+		{
+			// To show how much time we have left
+			rendering_percent_finished = composite.getNumberOfSamples() * 100.0f /
+				composite.getTotalNumberOfSamples();
+			double rendering_time_left = (rendering_time_elapsed / rendering_percent_finished) *
+				(100 - rendering_percent_finished);
+
+			int hours = rendering_time_left / (60 * 60);
+			int minutes = (int(rendering_time_left) % (60 * 60)) / 60;
+			int seconds = int(rendering_time_left) % 60;
+
+			std::cout << "Pass " << composite.getNumberOfPasses() << " finished, " <<
+				composite.getNumberOfSamples() << " of " << composite.getTotalNumberOfSamples() <<
+				" samples per pixel." << std::endl;
+			std::cout << "Estimated time left is "
+				<< hours << "h:"
+				<< minutes << "m:"
+				<< seconds << "s." << std::endl;
+		}
+
+		if (stop_requested || (settings.checkpoint_interval > 0 &&
+			difftime(time_now, last_checkpoint) >= settings.checkpoint_interval))
+		{
+			if (composite.saveCheckpoint(settings.checkpoint_file, NUMBER_OF_PHOTONS_EMISSION))
+				std::cout << "Checkpoint saved to " << settings.checkpoint_file << std::endl;
+			last_checkpoint = time_now;
+		}
+		if (stop_requested)
+			break;
+	}
+	double composite_error = composite.getRelativeError();
+	std::cout << "Composite samples per pixel : " << composite.getNumberOfSamples() << std::endl;
+	std::cout << "Estimated relative error : " << composite_error << std::endl;
+	{
+		std::lock_guard<std::mutex> lock(snapshot_mutex);
+		rendering_done = true;
+	}
+	snapshot_condition.notify_one();
+	snapshot_thread.join();
+	if (stop_requested)
+	{
+		std::cout << "Stopped after " << composite.getNumberOfSamples() <<
+			" samples per pixel, continue with --resume." << std::endl;
+		::operator delete[](irradiance_values);
+		delete [] pixel_values;
+		return EXIT_FAILURE;
+	}
+
+	// Mean over max busy time of the threads, 1 when all work until the end.
+	// The workers of a coordinator print their own.
+	double load_balance = 1;
+	if (settings.wavefront && !COORDINATOR)
+	{
+		std::cout << "Wavefront batches : " << composite.getNumberOfBatches() << std::endl;
+		for (int i = 0; i < WavefrontRenderer::N_STAGES; ++i)
+		{
+			std::cout << "Stage " << WavefrontRenderer::getStageName(i) << " : " <<
+				composite.getStageTime(i) << " s" << std::endl;
+		}
+	}
+	else if (!COORDINATOR)
+	{
+		// Load balance of the threads
+		double max_busy_time = 0;
+		double total_busy_time = 0;
+		for (int i = 0; i < composite.getNumberOfThreads(); ++i)
+		{
+			std::cout << "Thread " << i << " : busy " << composite.getBusyTime(i) << " s, " <<
+				composite.getNumberOfRenderedTiles(i) << " tiles, " <<
+				composite.getNumberOfStolenTiles(i) << " stolen" << std::endl;
+			max_busy_time = glm::max(max_busy_time, composite.getBusyTime(i));
+			total_busy_time += composite.getBusyTime(i);
+		}
+		load_balance = max_busy_time ?
+			total_busy_time / (composite.getNumberOfThreads() * max_busy_time) : 1;
+		std::cout << "Load balance : " << load_balance << std::endl;
+	}
 
-		double total_time_elapsed = prerender_time + rendering_time_elapsed;
-		double total_time_estimate = total_time_elapsed + rendering_time_left;
-		double total_time_left = total_time_estimate - total_time_elapsed;
+	// Same tiles on the same threads as when the buffers were first touched
+	scheduler.run([&](const TileScheduler::Tile& tile, int thread)
+	{
+		for (int y = tile.y0; y < tile.y1; ++y)
+		{
+			for (int x = tile.x0; x < tile.x1; ++x)
+			{
+				int index = x + y * c.WIDTH;
+				irradiance_values[index] += composite.getAccumulationBuffer().getEstimate(index);
+			}
+		}
+	}, false);
 
-		int hours = total_time_left / (60 * 60);
-		int minutes = (int(total_time_left) % (60 * 60)) / 60;
-		int seconds = int(total_time_left) % 60;
+	if (PROGRESSIVE)
+	{
+		ProgressivePhotonMapper ppm(
+			&s,
+			&c,
+			settings.progressive_photons_per_pass,
+			settings.progressive_initial_radius,
+			settings.progressive_alpha);
+		for (int k = 0; k < settings.progressive_passes; ++k)
+		{
+			ppm.renderPass();
+			std::cout << "Progressive photon mapping pass " << k + 1 << " of " <<
+				settings.progressive_passes << " finished." << std::endl;
+		}
+		for (int index = 0; index < c.WIDTH * c.HEIGHT; ++index)
+			irradiance_values[index] += ppm.getRadiance(index) * (2 * M_PI);
+	}
 
-		std::cout << rendering_percent_finished << " \% of rendering finished." << std::endl;
-		std::cout << "Estimated time left is "
-			<< hours << "h:"
-			<< minutes << "m:"
-			<< seconds << "s." << std::endl;
+	long monte_carlo_samples = long(SUB_SAMPLING_MONTE_CARLO) * c.WIDTH * c.HEIGHT;
+	if (ADAPTIVE)
+	{
+		AdaptiveRenderer adaptive(
+			&s,
+			&c,
+			DIFFUSE_RENDER_MODE,
+			settings.sampler_type,
+			Sampler::MONTE_CARLO_SEED,
+			settings.adaptive_min_samples,
+			settings.adaptive_max_samples,
+			settings.adaptive_threshold);
+		while (adaptive.renderRound())
+		{
+			std::cout << "Adaptive sampling round " << adaptive.getNumberOfRounds() <<
+				" finished, " << adaptive.getNumberOfActivePixels() <<
+				" pixels left." << std::endl;
+		}
+		for (int index = 0; index < c.WIDTH * c.HEIGHT; ++index)
+			irradiance_values[index] += adaptive.getRadiance(index) * (2 * M_PI);
+		monte_carlo_samples = adaptive.getTotalNumberOfSamples();
+		std::cout << "Adaptive sampling used " << monte_carlo_samples <<
+			" samples, " << double(monte_carlo_samples) / (c.WIDTH * c.HEIGHT) <<
+			" per pixel." << std::endl;
 	}
 
 	// To show how much time it actually took to render.
@@ -176,29 +521,26 @@ int main(int argc, char const *argv[])
 		+ std::to_string(seconds_prerender) + "s";
 
 	std::cout << "Rendering time : " << rendering_time_string << std::endl;
+	std::cout << "Average path length : " << s.getAveragePathLength() << std::endl;
+	std::cout << "Rays per sample : " << s.getRaysPerSample() << std::endl;
+	double rays_per_pixel = s.getRaysPerSample() * s.getNumberOfPaths() / (c.WIDTH * c.HEIGHT);
+	std::cout << "Rays per pixel : " << rays_per_pixel << std::endl;
 
 	// Convert to byte data
-	// Gamma correction
-	float gamma = 1 / 2.2;
-	for (int x = 0; x < c.WIDTH; ++x)
+	pool.parallelFor(0, c.HEIGHT, 1, [&](int y, int thread)
 	{
-		for (int y = 0; y < c.HEIGHT; ++y)
+		for (int x = 0; x < c.WIDTH; ++x)
 		{
 			int index = (x + y * c.WIDTH);
-			pixel_values[index * 3 + 0] = char(int(glm::clamp(
-				glm::pow(irradiance_values[index][0],gamma), 0.0f, 1.0f) * 255)); // Red
-			pixel_values[index * 3 + 1] = char(int(glm::clamp(
-				glm::pow(irradiance_values[index][1],gamma), 0.0f, 1.0f) * 255)); // Green
-			pixel_values[index * 3 + 2] = char(int(glm::clamp(
-				glm::pow(irradiance_values[index][2],gamma), 0.0f, 1.0f) * 255)); // Blue
+			image_io::toneMap(irradiance_values[index], gamma, &pixel_values[index * 3]);
 		}
-	}
+	});
 
 	std::string date_time = currentDateTime();
 	std::string file_name = date_time + ".ppm";
   
 	// Save the image data to file
-	savePPM(file_name.c_str(), WIDTH, HEIGHT, pixel_values);
+	image_io::savePPM(file_name.c_str(), WIDTH, HEIGHT, pixel_values);
 
 	// Save information in a text file
 	std::ofstream myfile;
@@ -210,17 +552,59 @@ int main(int argc, char const *argv[])
 	myfile << "Resolution                   : " + std::to_string(WIDTH) + " x " + std::to_string(HEIGHT) + "\n";
 	myfile << "Caustic sub sampling         : " + std::to_string(SUB_SAMPLING_CAUSTICS) + "\n";
 	myfile << "Monte Carlo sub sampling     : " + std::to_string(SUB_SAMPLING_MONTE_CARLO) + "\n";
+	if (ADAPTIVE)
+	{
+		myfile << "Adaptive threshold           : " + std::to_string(settings.adaptive_threshold) + "\n";
+		myfile << "Adaptive samples per pixel   : " + std::to_string(settings.adaptive_min_samples) +
+			" - " + std::to_string(settings.adaptive_max_samples) + "\n";
+	}
+	myfile << "Monte Carlo samples in total : " + std::to_string(monte_carlo_samples) + "\n";
 	myfile << "Direct specular sub sampling : " + std::to_string(SUB_SAMPLING_DIRECT_SPECULAR) + "\n";
+	myfile << "Composite passes             : " + std::to_string(composite.getNumberOfPasses()) +
+		" of " + std::to_string(composite.getPassSamples()) + " samples per pixel\n";
+	myfile << "Composite samples per pixel  : " + std::to_string(composite.getNumberOfSamples()) + "\n";
+	myfile << "Estimated relative error     : " + std::to_string(composite_error) + "\n";
+	if (settings.time_limit > 0)
+		myfile << "Time limit                   : " + std::to_string(settings.time_limit) + " s\n";
+	if (settings.target_noise > 0)
+		myfile << "Target noise                 : " + std::to_string(settings.target_noise) + "\n";
+	myfile << "Path depth                   : " + std::to_string(settings.min_path_depth) +
+		" - " + std::to_string(settings.max_path_depth) + "\n";
+	myfile << "First bounce splitting       : " + std::to_string(settings.first_bounce_splits) + "\n";
+	myfile << "Fresnel sampling             : " + std::string(settings.stochastic_fresnel ? "on" : "off") + "\n";
+	myfile << "Average path length          : " + std::to_string(s.getAveragePathLength()) + "\n";
+	myfile << "Rays per sample              : " + std::to_string(s.getRaysPerSample()) + "\n";
+	myfile << "Rays per pixel               : " + std::to_string(rays_per_pixel) + "\n";
 	myfile << "Emitted photons              : " + std::to_string(NUMBER_OF_PHOTONS_EMISSION) + "\n";
-	myfile << "Photons in scene             : " + std::to_string(s.getNumberOfPhotons()) + "\n";
+	if (PROGRESSIVE)
+	{
+		myfile << "Progressive passes           : " + std::to_string(settings.progressive_passes) + "\n";
+		myfile << "Photons per pass             : " + std::to_string(settings.progressive_photons_per_pass) + "\n";
+		myfile << "Initial gather radius        : " + std::to_string(settings.progressive_initial_radius) + "\n";
+		myfile << "Alpha                        : " + std::to_string(settings.progressive_alpha) + "\n";
+	}
+	myfile << "Caustic photons in scene     : " + std::to_string(s.getNumberOfCausticPhotons()) + "\n";
+	myfile << "Irradiance photons in scene  : " + std::to_string(s.getNumberOfIrradiancePhotons()) + "\n";
 	myfile << "Objects in scene             : " + std::to_string(s.getNumberOfObjects()) + "\n";
 	myfile << "Spheres in scene             : " + std::to_string(s.getNumberOfSpheres()) + "\n";
 	myfile << "Triangles in scene           : " + std::to_string(s.getNumberOfTriangles()) + "\n";
+	myfile << "Sampler                      : " + std::string(Sampler::getTypeName(settings.sampler_type)) + "\n";
+	if (settings.wavefront)
+		myfile << "Wavefront batch              : " + std::to_string(settings.wavefront_batch_size) + " paths\n";
+	else
+	{
+		myfile << "Tiles                        : " + std::to_string(settings.tile_size) + " x " +
+			std::to_string(settings.tile_size) + ", " + TileScheduler::getOrderName(settings.tile_order) + " order\n";
+		myfile << "Load balance                 : " + std::to_string(load_balance) + "\n";
+	}
+	myfile << "Threads                      : " + std::to_string(scheduler.getNumberOfThreads()) + "\n";
+	if (COORDINATOR)
+		myfile << "Workers                      : " + std::to_string(n_workers) + "\n";
 	myfile << "Gamma                        : " + std::to_string(gamma) + "\n";
 	myfile.close();
 
 	// Clean up
-	delete [] irradiance_values;
+	::operator delete[](irradiance_values);
 	delete [] pixel_values;
   
 	// Make a beep sound
@@ -195,4 +195,25 @@ SpectralDistribution evaluateOrenNayarBRDF(
 	return
 	albedo / M_PI *
 	(A + (B * glm::max(0.0f, cos_d1_d2)) * glm::sin(alpha) * glm::tan(beta));
+}
+
+float powerHeuristic(float pdf_a, float pdf_b)
+{
+	float a = pdf_a * pdf_a;
+	float b = pdf_b * pdf_b;
+	return a + b > 0 ? a / (a + b) : 0;
+}
+
+SpectralDistribution evaluateDiffuseBRDF(
+	glm::vec3 d1,
+	glm::vec3 d2,
+	glm::vec3 normal,
+	const Material& material)
+{
+	SpectralDistribution albedo =
+		material.color_diffuse * material.reflectance * (1 - material.specular_reflectance);
+	if (material.diffuse_roughness)
+		return evaluateOrenNayarBRDF(d1, d2, normal, albedo, material.diffuse_roughness);
+	else
+		return evaluateLambertianBRDF(d1, d2, normal, albedo);
 }
\ No newline at end of file
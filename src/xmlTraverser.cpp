@@ -127,6 +127,7 @@ bool scene_traverser::for_each(pugi::xml_node& node)
             node.traverse(walker);
 
             object = new Mesh(mesh_transform, file_path.c_str(), scene->materials_[material_id]);
+            scene->mesh_file_paths_.push_back(file_path);
         }
         scene->objects_.push_back(object);
     }
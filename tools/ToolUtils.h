@@ -0,0 +1,148 @@
+#ifndef TOOL_UTILS_H
+#define TOOL_UTILS_H
+
+#include <vector>
+#include <cmath>
+#include <cstdlib>
+#include <chrono>
+
+#include <glm/glm.hpp>
+
+#include "../include/Camera.h"
+#include "../include/Scene.h"
+#include "../include/Sampler.h"
+#include "../include/ThreadPool.h"
+
+// Helpers shared by the measuring tools
+
+typedef std::chrono::steady_clock Clock;
+
+inline double secondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// The tools take "scene_file.xml [width height ...]". The size is only
+// read if both are given, the optional argument i if it is there.
+inline void readImageSize(int argc, char const *argv[], int* width, int* height)
+{
+	if (argc > 3)
+	{
+		*width = atoi(argv[2]);
+		*height = atoi(argv[3]);
+	}
+}
+
+inline int intArgument(int argc, char const *argv[], int i, int default_value)
+{
+	return argc > i ? atoi(argv[i]) : default_value;
+}
+
+inline double floatArgument(int argc, char const *argv[], int i, double default_value)
+{
+	return argc > i ? atof(argv[i]) : default_value;
+}
+
+// The render modes of camera rays and their names
+const int CAMERA_RENDER_MODES[] =
+	{Scene::WHITTED_SPECULAR, Scene::CAUSTICS, Scene::MONTE_CARLO, Scene::FINAL_GATHERING};
+const char* const CAMERA_RENDER_MODE_NAMES[] =
+	{"specular", "caustics", "monte carlo", "final gathering"};
+const int N_CAMERA_RENDER_MODES = sizeof(CAMERA_RENDER_MODES) / sizeof(CAMERA_RENDER_MODES[0]);
+
+// The camera of the main program
+inline Camera createCamera(int width, int height)
+{
+	return Camera(
+		glm::vec3(0, 0, 3.2), // Eye (position of camera)
+		glm::vec3(0, 0, 0), // Center (position to look at)
+		glm::vec3(0, 1, 0), // Up vector
+		M_PI / 3, // Field of view in radians
+		width, // pixel width
+		height); // pixel height
+}
+
+// Image of one render mode with spp samples in every pixel, scaled like
+// the output of the main program. Traced with Scene::tracePath() or, if not
+// iterative, the recursive Scene::traceRay().
+inline std::vector<SpectralDistribution> render(
+	Scene* s,
+	Camera* c,
+	int render_mode,
+	int sampler_type,
+	unsigned int seed,
+	int spp,
+	bool iterative = true)
+{
+	std::vector<SpectralDistribution> image(c->WIDTH * c->HEIGHT);
+	glm::vec3 camera_plane_normal = glm::normalize(c->center - c->eye);
+	ThreadPool::instance().parallelFor(0, image.size(), 1, [&](int index, int thread)
+	{
+		int x = index % c->WIDTH;
+		int y = index / c->WIDTH;
+		Sampler* sampler = Sampler::create(sampler_type, seed);
+		SpectralDistribution sd;
+		for (int i = 0; i < spp; ++i)
+		{
+			sampler->startSample(index, i, spp);
+			glm::vec2 jitter = sampler->next2D() - 0.5f;
+			Ray r = c->castRay(x, (c->HEIGHT - y - 1), jitter.x, jitter.y);
+			SpectralDistribution radiance = iterative ?
+				s->tracePath(r, render_mode, sampler) :
+				s->traceRay(r, render_mode, sampler);
+			sd += radiance * glm::dot(r.direction, camera_plane_normal);
+		}
+		image[index] = sd / spp * (2 * M_PI);
+		delete sampler;
+	});
+	return image;
+}
+
+// Mean over the pixels and wavelengths
+inline float meanValue(std::vector<SpectralDistribution>& image)
+{
+	double sum = 0;
+	for (int i = 0; i < image.size(); ++i)
+	{
+		for (int j = 0; j < SpectralDistribution::N_WAVELENGTHS; ++j)
+			sum += image[i][j];
+	}
+	return sum / (image.size() * SpectralDistribution::N_WAVELENGTHS);
+}
+
+inline double rootMeanSquareError(
+	std::vector<SpectralDistribution>& image,
+	std::vector<SpectralDistribution>& reference)
+{
+	double sum = 0;
+	for (int i = 0; i < image.size(); ++i)
+	{
+		for (int j = 0; j < SpectralDistribution::N_WAVELENGTHS; ++j)
+		{
+			double difference = image[i][j] - reference[i][j];
+			sum += difference * difference;
+		}
+	}
+	return sqrt(sum / (image.size() * SpectralDistribution::N_WAVELENGTHS));
+}
+
+// Root mean square of the error relative to the reference, dark pixels are
+// compared to a floor of 0.01 instead
+inline double relativeRootMeanSquareError(
+	std::vector<SpectralDistribution>& image,
+	std::vector<SpectralDistribution>& reference)
+{
+	double sum = 0;
+	for (int i = 0; i < image.size(); ++i)
+	{
+		for (int j = 0; j < SpectralDistribution::N_WAVELENGTHS; ++j)
+		{
+			double difference = (image[i][j] - reference[i][j]) /
+				glm::max(reference[i][j], 0.01f);
+			sum += difference * difference;
+		}
+	}
+	return sqrt(sum / (image.size() * SpectralDistribution::N_WAVELENGTHS));
+}
+
+#endif // TOOL_UTILS_H
@@ -0,0 +1,98 @@
+// Adaptive against uniform sampling at equal cost.
+//
+// Renders the Monte Carlo part of a small image with adaptive sampling,
+// then with the same number of samples spread uniformly over the pixels.
+// Prints the samples, time and the absolute and relative root mean square
+// error against a reference of both, and the error of the uniform image
+// rendered for the time the adaptive one took. The adaptive criterion is
+// relative, so it is expected to win on the relative error.
+//
+// Usage: adaptive_comparison scene_file.xml [width height threshold]
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+
+#include "ToolUtils.h"
+#include "../include/AdaptiveRenderer.h"
+
+namespace
+{
+	void report(
+		const char* name,
+		long n_samples,
+		double seconds,
+		std::vector<SpectralDistribution>& image,
+		std::vector<SpectralDistribution>& reference)
+	{
+		std::cout << std::setw(22) << name <<
+			std::setw(12) << n_samples <<
+			std::setw(10) << std::setprecision(3) << seconds << " s" <<
+			std::setw(12) << std::setprecision(5) << rootMeanSquareError(image, reference) <<
+			std::setw(14) << std::setprecision(5) << relativeRootMeanSquareError(image, reference) <<
+			std::endl;
+	}
+}
+
+int main(int argc, char const *argv[])
+{
+	if (argc < 2)
+	{
+		std::cout << "Usage: " << argv[0] << " scene_file.xml [width height threshold]" << std::endl;
+		return EXIT_FAILURE;
+	}
+	int width = 48;
+	int height = 36;
+	readImageSize(argc, argv, &width, &height);
+	float threshold = floatArgument(argc, argv, 4, 0.05);
+	static const int MIN_SAMPLES = 16;
+	static const int MAX_SAMPLES = 1024;
+	static const int REFERENCE_SPP = 2048;
+	int n_pixels = width * height;
+
+	Camera c = createCamera(width, height);
+	Scene s(argv[1]);
+
+	std::cout << "Rendering reference with " << REFERENCE_SPP << " spp." << std::endl;
+	std::vector<SpectralDistribution> reference = render(
+		&s, &c, Scene::MONTE_CARLO, Sampler::INDEPENDENT, 1000, REFERENCE_SPP);
+
+	Clock::time_point start = Clock::now();
+	AdaptiveRenderer adaptive(
+		&s, &c, Scene::MONTE_CARLO, Sampler::INDEPENDENT, Sampler::MONTE_CARLO_SEED,
+		MIN_SAMPLES, MAX_SAMPLES, threshold);
+	while (adaptive.renderRound())
+		;
+	double adaptive_time = secondsSince(start);
+	std::vector<SpectralDistribution> adaptive_image(n_pixels);
+	for (int i = 0; i < n_pixels; ++i)
+		adaptive_image[i] = adaptive.getRadiance(i) * (2 * M_PI);
+	long adaptive_samples = adaptive.getTotalNumberOfSamples();
+
+	// Same number of samples
+	int spp = glm::max(1, int(adaptive_samples / n_pixels));
+	start = Clock::now();
+	std::vector<SpectralDistribution> uniform = render(
+		&s, &c, Scene::MONTE_CARLO, Sampler::INDEPENDENT, Sampler::MONTE_CARLO_SEED, spp);
+	double uniform_time = secondsSince(start);
+
+	// Same time, the samples per pixel scaled by the measured time ratio
+	int equal_time_spp = glm::max(1, int(spp * adaptive_time / uniform_time + 0.5));
+	start = Clock::now();
+	std::vector<SpectralDistribution> equal_time = render(
+		&s, &c, Scene::MONTE_CARLO, Sampler::INDEPENDENT, Sampler::MONTE_CARLO_SEED, equal_time_spp);
+	double equal_time_time = secondsSince(start);
+
+	std::cout << "Adaptive threshold " << threshold << ", " <<
+		adaptive.getNumberOfRounds() << " rounds, " <<
+		MIN_SAMPLES << " - " << MAX_SAMPLES << " samples per pixel." << std::endl;
+	std::cout << std::setw(22) << "allocation" << std::setw(12) << "samples" <<
+		std::setw(12) << "time" << std::setw(12) << "rmse" <<
+		std::setw(14) << "relative rmse" << std::endl;
+	report("adaptive", adaptive_samples, adaptive_time, adaptive_image, reference);
+	report("uniform equal samples", long(spp) * n_pixels, uniform_time, uniform, reference);
+	report("uniform equal time", long(equal_time_spp) * n_pixels, equal_time_time,
+		equal_time, reference);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,66 @@
+// Rays and noise of branching and stochastic Fresnel selection at glass.
+//
+// Renders a small image of the specular and Monte Carlo render modes with
+// both reflected and refracted rays traced at every glass surface, and with
+// one of them picked by the Fresnel term. Prints the rays per pixel, time,
+// root mean square error against a branching reference and the error
+// squared times the time (lower is more efficient).
+//
+// Usage: fresnel_comparison scene_file.xml [width height spp]
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+
+#include "ToolUtils.h"
+
+int main(int argc, char const *argv[])
+{
+	if (argc < 2)
+	{
+		std::cout << "Usage: " << argv[0] << " scene_file.xml [width height spp]" << std::endl;
+		return EXIT_FAILURE;
+	}
+	int width = 48;
+	int height = 36;
+	readImageSize(argc, argv, &width, &height);
+	int spp = intArgument(argc, argv, 4, 32);
+	static const int REFERENCE_SPP = 1024;
+	static const int RENDER_MODES[] = {Scene::WHITTED_SPECULAR, Scene::MONTE_CARLO};
+	static const char* RENDER_MODE_NAMES[] = {"specular", "monte carlo"};
+
+	Camera c = createCamera(width, height);
+	Scene s(argv[1]);
+
+	std::cout << std::setw(12) << "mode" << std::setw(12) << "fresnel" <<
+		std::setw(16) << "rays/pixel" << std::setw(12) << "time" <<
+		std::setw(12) << "rmse" << std::setw(14) << "rmse^2 * t" << std::endl;
+	for (int i = 0; i < sizeof(RENDER_MODES) / sizeof(RENDER_MODES[0]); ++i)
+	{
+		s.setStochasticFresnel(false);
+		std::vector<SpectralDistribution> reference = render(
+			&s, &c, RENDER_MODES[i], Sampler::INDEPENDENT, 1000, REFERENCE_SPP);
+
+		for (int stochastic = 0; stochastic < 2; ++stochastic)
+		{
+			s.setStochasticFresnel(stochastic);
+			s.resetRayStatistics();
+			Clock::time_point start = Clock::now();
+			std::vector<SpectralDistribution> image = render(
+				&s, &c, RENDER_MODES[i], Sampler::SOBOL, Sampler::MONTE_CARLO_SEED, spp);
+			double seconds = secondsSince(start);
+			double rmse = rootMeanSquareError(image, reference);
+
+			std::cout << std::setw(12) << RENDER_MODE_NAMES[i] <<
+				std::setw(12) << (stochastic ? "sampled" : "branched") <<
+				std::setw(16) << std::setprecision(4) <<
+					s.getRaysPerSample() * s.getNumberOfPaths() / (width * height) <<
+				std::setw(10) << std::setprecision(3) << seconds << " s" <<
+				std::setw(12) << std::setprecision(4) << rmse <<
+				std::setw(14) << std::setprecision(4) << rmse * rmse * seconds <<
+				std::endl;
+		}
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,57 @@
+// Error against samples per pixel for each sampler type.
+//
+// Renders the Monte Carlo part of a small image with every sampler for
+// 1, 2, 4 ... max_spp samples per pixel and prints the root mean square
+// error against a reference image with many more independent samples.
+//
+// Usage: sampler_comparison scene_file.xml [width height max_spp]
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+#include <cmath>
+
+#include "ToolUtils.h"
+
+int main(int argc, char const *argv[])
+{
+	if (argc < 2)
+	{
+		std::cout << "Usage: " << argv[0] << " scene_file.xml [width height max_spp]" << std::endl;
+		return EXIT_FAILURE;
+	}
+	int width = 64;
+	int height = 48;
+	readImageSize(argc, argv, &width, &height);
+	int max_spp = intArgument(argc, argv, 4, 64);
+	// Rendered with a seed that no sampler below uses
+	int reference_spp = max_spp * 16;
+	unsigned int reference_seed = 1000;
+
+	Camera c = createCamera(width, height);
+	Scene s(argv[1]);
+
+	std::cout << "Rendering reference with " << reference_spp << " spp." << std::endl;
+	std::vector<SpectralDistribution> reference =
+		render(&s, &c, Scene::MONTE_CARLO, Sampler::INDEPENDENT, reference_seed, reference_spp);
+
+	std::cout << std::setw(8) << "spp";
+	for (int type = 0; type < Sampler::N_TYPES; ++type)
+		std::cout << std::setw(14) << Sampler::getTypeName(type);
+	std::cout << std::endl;
+
+	for (int spp = 1; spp <= max_spp; spp *= 2)
+	{
+		std::cout << std::setw(8) << spp;
+		for (int type = 0; type < Sampler::N_TYPES; ++type)
+		{
+			std::vector<SpectralDistribution> image =
+				render(&s, &c, Scene::MONTE_CARLO, type, Sampler::MONTE_CARLO_SEED, spp);
+			std::cout << std::setw(14) << std::setprecision(5) <<
+				rootMeanSquareError(image, reference) << std::flush;
+		}
+		std::cout << std::endl;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,117 @@
+// Microbenchmark of cosine weighted direction generation.
+//
+// Compares the rotation based construction that the renderer used before
+// (acos, sqrt, two glm::rotate and two normalize per direction) with the
+// orthonormal basis and concentric disc mapping in Warp.h, one direction at
+// a time and in batches. The mean of cos(theta) should be 2 / 3 for all.
+//
+// Usage: sampling_benchmark [n_directions]
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+
+#include "../include/Warp.h"
+#include "../include/Sampler.h"
+
+namespace
+{
+	glm::vec3 rotateCosineHemisphere(glm::vec3 normal, glm::vec2 sample)
+	{
+		glm::vec3 helper = normal + glm::vec3(1,1,1);
+		glm::vec3 tangent = glm::normalize(glm::cross(normal, helper));
+		float inclination = acos(sqrt(sample.x));
+		float azimuth = 2 * M_PI * sample.y;
+		glm::vec3 d = normal;
+		d = glm::normalize(glm::rotate(d, inclination, tangent));
+		d = glm::normalize(glm::rotate(d, azimuth, normal));
+		return d;
+	}
+
+	void report(const char* name, double seconds, int n, double cos_sum, double reference)
+	{
+		double ns = seconds * 1e9 / n;
+		std::cout << std::setw(12) << name <<
+			std::setw(12) << std::setprecision(4) << ns << " ns" <<
+			std::setw(10) << std::setprecision(3) << (reference > 0 ? reference / ns : 1) << "x" <<
+			std::setw(14) << std::setprecision(6) << cos_sum / n << std::endl;
+	}
+}
+
+int main(int argc, char const *argv[])
+{
+	int n = argc > 1 ? atoi(argv[1]) : 1 << 22;
+	static const int BATCH_SIZE = 256;
+	n = (n + BATCH_SIZE - 1) / BATCH_SIZE * BATCH_SIZE;
+
+	std::vector<float> u(n), v(n);
+	IndependentSampler sampler;
+	for (int i = 0; i < n; ++i)
+	{
+		sampler.startSample(0, i);
+		glm::vec2 sample = sampler.next2D();
+		u[i] = sample.x;
+		v[i] = sample.y;
+	}
+	// One normal per batch, as for the samples of one shading point
+	std::vector<glm::vec3> normals(n / BATCH_SIZE);
+	for (int i = 0; i < normals.size(); ++i)
+	{
+		sampler.startSample(1, i);
+		normals[i] = warp::squareToUniformSphere(sampler.next2D());
+	}
+	std::vector<float> x(n), y(n), z(n);
+
+	std::cout << n << " directions, batches of " << BATCH_SIZE << std::endl;
+	std::cout << std::setw(12) << "method" << std::setw(15) << "per direction" <<
+		std::setw(11) << "speedup" << std::setw(14) << "mean cos" << std::endl;
+
+	typedef std::chrono::high_resolution_clock Clock;
+	double cos_sum;
+
+	Clock::time_point start = Clock::now();
+	for (int i = 0; i < n; ++i)
+	{
+		glm::vec3 d = rotateCosineHemisphere(normals[i / BATCH_SIZE], glm::vec2(u[i], v[i]));
+		x[i] = d.x; y[i] = d.y; z[i] = d.z;
+	}
+	double rotate_time = std::chrono::duration<double>(Clock::now() - start).count();
+	cos_sum = 0;
+	for (int i = 0; i < n; ++i)
+		cos_sum += glm::dot(glm::vec3(x[i], y[i], z[i]), normals[i / BATCH_SIZE]);
+	report("rotate", rotate_time, n, cos_sum, 0);
+	double rotate_ns = rotate_time * 1e9 / n;
+
+	start = Clock::now();
+	for (int i = 0; i < n; ++i)
+	{
+		glm::vec3 d = warp::cosineHemisphere(normals[i / BATCH_SIZE], glm::vec2(u[i], v[i]));
+		x[i] = d.x; y[i] = d.y; z[i] = d.z;
+	}
+	double scalar_time = std::chrono::duration<double>(Clock::now() - start).count();
+	cos_sum = 0;
+	for (int i = 0; i < n; ++i)
+		cos_sum += glm::dot(glm::vec3(x[i], y[i], z[i]), normals[i / BATCH_SIZE]);
+	report("scalar", scalar_time, n, cos_sum, rotate_ns);
+
+	start = Clock::now();
+	for (int i = 0; i < n; i += BATCH_SIZE)
+	{
+		warp::cosineHemisphere(
+			normals[i / BATCH_SIZE],
+			&u[i], &v[i], BATCH_SIZE,
+			&x[i], &y[i], &z[i]);
+	}
+	double batch_time = std::chrono::duration<double>(Clock::now() - start).count();
+	cos_sum = 0;
+	for (int i = 0; i < n; ++i)
+		cos_sum += glm::dot(glm::vec3(x[i], y[i], z[i]), normals[i / BATCH_SIZE]);
+	report("batch", batch_time, n, cos_sum, rotate_ns);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+// Noise of first bounce splitting at equal time.
+//
+// For each number of splits, the time per sample per pixel is measured on a
+// short render, then the Monte Carlo part of a small image is rendered with
+// as many samples as fit in the time budget. Prints the samples, rays per
+// sample, time and root mean square error against a reference.
+//
+// Usage: splitting_comparison scene_file.xml [width height seconds]
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+
+#include "ToolUtils.h"
+
+int main(int argc, char const *argv[])
+{
+	if (argc < 2)
+	{
+		std::cout << "Usage: " << argv[0] << " scene_file.xml [width height seconds]" << std::endl;
+		return EXIT_FAILURE;
+	}
+	int width = 48;
+	int height = 36;
+	readImageSize(argc, argv, &width, &height);
+	double time_budget = floatArgument(argc, argv, 4, 5);
+	static const int REFERENCE_SPP = 2048;
+	static const int CALIBRATION_SPP = 4;
+	static const int SPLITS[] = {1, 2, 4, 8, 16};
+
+	Camera c = createCamera(width, height);
+	Scene s(argv[1]);
+
+	std::cout << "Rendering reference with " << REFERENCE_SPP << " spp." << std::endl;
+	std::vector<SpectralDistribution> reference = render(
+		&s, &c, Scene::MONTE_CARLO, Sampler::INDEPENDENT, 1000, REFERENCE_SPP);
+
+	std::cout << std::setw(8) << "splits" << std::setw(8) << "spp" <<
+		std::setw(16) << "rays/sample" << std::setw(12) << "time" <<
+		std::setw(12) << "rmse" << std::endl;
+	for (int i = 0; i < sizeof(SPLITS) / sizeof(SPLITS[0]); ++i)
+	{
+		s.setFirstBounceSplitting(SPLITS[i]);
+
+		Clock::time_point start = Clock::now();
+		render(&s, &c, Scene::MONTE_CARLO, Sampler::SOBOL, Sampler::MONTE_CARLO_SEED, CALIBRATION_SPP);
+		double seconds_per_spp = secondsSince(start) / CALIBRATION_SPP;
+		int spp = glm::max(1, int(time_budget / seconds_per_spp));
+
+		s.resetRayStatistics();
+		start = Clock::now();
+		std::vector<SpectralDistribution> image = render(
+			&s, &c, Scene::MONTE_CARLO, Sampler::SOBOL, Sampler::MONTE_CARLO_SEED, spp);
+		double seconds = secondsSince(start);
+
+		std::cout << std::setw(8) << SPLITS[i] << std::setw(8) << spp <<
+			std::setw(16) << std::setprecision(4) << s.getRaysPerSample() <<
+			std::setw(10) << std::setprecision(3) << seconds << " s" <<
+			std::setw(12) << std::setprecision(5) << rootMeanSquareError(image, reference) <<
+			std::endl;
+	}
+	return EXIT_SUCCESS;
+}
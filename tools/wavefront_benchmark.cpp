@@ -0,0 +1,87 @@
+// Path at a time and wavefront tracing of the same image.
+//
+// Renders a small image with Scene::tracePath() and with the
+// WavefrontRenderer for each camera render mode and prints the time, the
+// mean pixel value and the error of both against a reference with
+// REFERENCE_FACTOR times as many samples. The branches of a wavefront path
+// use other random numbers than tracePath(), so the images only agree up to
+// noise. The time of each wavefront stage is printed below.
+//
+// Usage: wavefront_benchmark scene_file.xml [width height spp batch_size]
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+
+#include "ToolUtils.h"
+#include "../include/WavefrontRenderer.h"
+
+int main(int argc, char const *argv[])
+{
+	if (argc < 2)
+	{
+		std::cout << "Usage: " << argv[0] << " scene_file.xml [width height spp batch_size]" << std::endl;
+		return EXIT_FAILURE;
+	}
+	int width = 64;
+	int height = 48;
+	readImageSize(argc, argv, &width, &height);
+	int spp = intArgument(argc, argv, 4, 64);
+	int batch_size = intArgument(argc, argv, 5, 1 << 16);
+	static const int N_PHOTONS = 200000;
+	static const int REFERENCE_FACTOR = 8;
+
+	Camera c = createCamera(width, height);
+	Scene s(argv[1]);
+	s.buildPhotonMap(N_PHOTONS);
+	WavefrontRenderer wavefront(&s, &c, Sampler::SOBOL, Sampler::MONTE_CARLO_SEED, batch_size);
+	double stage_times[N_CAMERA_RENDER_MODES][WavefrontRenderer::N_STAGES];
+
+	std::cout << std::setw(16) << "mode" <<
+		std::setw(14) << "path" << std::setw(14) << "wavefront" <<
+		std::setw(12) << "mean path" << std::setw(12) << "mean wave" <<
+		std::setw(12) << "rmse path" << std::setw(12) << "rmse wave" << std::endl;
+	for (int i = 0; i < N_CAMERA_RENDER_MODES; ++i)
+	{
+		std::vector<SpectralDistribution> reference = render(
+			&s, &c, CAMERA_RENDER_MODES[i], Sampler::SOBOL, Sampler::MONTE_CARLO_SEED + 1,
+			spp * REFERENCE_FACTOR);
+
+		Clock::time_point start = Clock::now();
+		std::vector<SpectralDistribution> path = render(
+			&s, &c, CAMERA_RENDER_MODES[i], Sampler::SOBOL, Sampler::MONTE_CARLO_SEED, spp);
+		double path_seconds = secondsSince(start);
+
+		start = Clock::now();
+		wavefront.render(CAMERA_RENDER_MODES[i], 0, spp, spp);
+		std::vector<SpectralDistribution> wave(width * height);
+		for (int j = 0; j < wave.size(); ++j)
+			wave[j] = wavefront.getRadianceSum(j) / spp * (2 * M_PI);
+		double wavefront_seconds = secondsSince(start);
+		for (int j = 0; j < WavefrontRenderer::N_STAGES; ++j)
+			stage_times[i][j] = wavefront.getStageTime(j);
+
+		std::cout << std::setw(16) << CAMERA_RENDER_MODE_NAMES[i] <<
+			std::setw(12) << std::setprecision(3) << path_seconds << " s" <<
+			std::setw(12) << std::setprecision(3) << wavefront_seconds << " s" <<
+			std::setw(12) << std::setprecision(4) << meanValue(path) <<
+			std::setw(12) << std::setprecision(4) << meanValue(wave) <<
+			std::setw(12) << std::setprecision(4) << rootMeanSquareError(path, reference) <<
+			std::setw(12) << std::setprecision(4) << rootMeanSquareError(wave, reference) <<
+			std::endl;
+	}
+
+	std::cout << std::endl << "Wavefront stage times (s)" << std::endl << std::setw(16) << "mode";
+	for (int j = 0; j < WavefrontRenderer::N_STAGES; ++j)
+		std::cout << std::setw(12) << WavefrontRenderer::getStageName(j);
+	std::cout << std::endl;
+	for (int i = 0; i < N_CAMERA_RENDER_MODES; ++i)
+	{
+		std::cout << std::setw(16) << CAMERA_RENDER_MODE_NAMES[i];
+		for (int j = 0; j < WavefrontRenderer::N_STAGES; ++j)
+			std::cout << std::setw(12) << std::setprecision(3) << stage_times[i][j];
+		std::cout << std::endl;
+	}
+	return EXIT_SUCCESS;
+}